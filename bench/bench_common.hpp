@@ -0,0 +1,40 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+// shared by the tools in bench/, each one builds on its own from the repository root (see the top of every file)
+
+// best wall time of repeats runs in seconds, the least disturbed run is the closest to the real cost
+template <typename t_task>
+double best_seconds(int repeats, const t_task& task) {
+    double best = 1e30;
+    for (int i = 0; i < repeats; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        task();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// xorshift32, fixtures come out the same on every run and machine
+struct c_bench_random {
+    uint32_t state = 0x9e3779b9u;
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    float unit() {
+        return static_cast<float>(next() >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+// keeps a result alive so the optimizer can't drop the work being timed
+inline void consume(uint64_t value) {
+    static volatile uint64_t sink = 0;
+    sink = sink + value;
+}
@@ -0,0 +1,160 @@
+// decompression throughput of compression/ against the stb path the parsers used before it
+// build from the repository root:
+//   g++ -O2 -std=c++17 bench/decompress_bench.cpp compression/decompress.cpp compression/inflate_stream.cpp -lz -o decompress_bench
+// usage: decompress_bench [payload megabytes, default 16]
+#define STB_IMAGE_IMPLEMENTATION
+#include "../../ext/imgui/stb_image.h"
+
+#include "../compression/decompress.hpp"
+#include "../compression/inflate_stream.hpp"
+#include "bench_common.hpp"
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr int repeats = 5;
+    constexpr size_t network_chunk = 16 * 1024; // roughly what one curl write callback hands over
+
+    // obj text shaped like an avatar export, so the compression ratio matches the real payloads
+    std::vector<unsigned char> make_obj(size_t target_size) {
+        c_bench_random random;
+        std::string text;
+        text.reserve(target_size + 256);
+        char line[128];
+        int vertices = 0;
+
+        while (text.size() < target_size) {
+            for (int i = 0; i < 64; i++, vertices++) {
+                snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", random.unit() * 4.0f - 2.0f, random.unit() * 6.0f,
+                         random.unit() * 2.0f - 1.0f);
+                text += line;
+                snprintf(line, sizeof(line), "vt %.6f %.6f\n", random.unit(), random.unit());
+                text += line;
+                snprintf(line, sizeof(line), "vn %.4f %.4f %.4f\n", random.unit(), random.unit(), random.unit());
+                text += line;
+            }
+            for (int i = 0; i < 64; i++) {
+                const int a = vertices - 1 - static_cast<int>(random.next() % 64);
+                const int b = vertices - 1 - static_cast<int>(random.next() % 64);
+                const int c = vertices - 1 - static_cast<int>(random.next() % 64);
+                snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a + 1, a + 1, a + 1, b + 1, b + 1, b + 1,
+                         c + 1, c + 1, c + 1);
+                text += line;
+            }
+        }
+        return std::vector<unsigned char>(text.begin(), text.end());
+    }
+
+    std::vector<unsigned char> deflate_payload(const std::vector<unsigned char>& raw, bool gzip) {
+        z_stream stream{};
+        if (deflateInit2(&stream, 6, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return {};
+        }
+
+        std::vector<unsigned char> out(deflateBound(&stream, static_cast<uLong>(raw.size())) + 32);
+        stream.next_in = const_cast<Bytef*>(raw.data());
+        stream.avail_in = static_cast<uInt>(raw.size());
+        stream.next_out = out.data();
+        stream.avail_out = static_cast<uInt>(out.size());
+        const int result = deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return result == Z_STREAM_END ? out : std::vector<unsigned char>();
+    }
+
+    // what obj_parser, mtl_parser and fetch_model_json each did before: stb decodes into a malloc'd buffer that
+    // is copied into a vector. stb only reads zlib framing, the gzip the cdn sends failed here
+    bool stb_decompress(const std::vector<unsigned char>& data, std::vector<unsigned char>& out) {
+        int outlen = 0;
+        char* decoded = stbi_zlib_decode_malloc(reinterpret_cast<const char*>(data.data()),
+                                                static_cast<int>(data.size()), &outlen);
+        if (!decoded) {
+            return false;
+        }
+
+        out.assign(decoded, decoded + outlen);
+        free(decoded);
+        return true;
+    }
+
+    bool stream_decompress(const std::vector<unsigned char>& data, std::vector<unsigned char>& out) {
+        out.clear();
+        c_inflate_stream stream([&out](const unsigned char* bytes, size_t size) {
+            out.insert(out.end(), bytes, bytes + size);
+            return true;
+        });
+
+        for (size_t offset = 0; offset < data.size(); offset += network_chunk) {
+            if (!stream.write(data.data() + offset, std::min(network_chunk, data.size() - offset))) {
+                return false;
+            }
+        }
+        return stream.finish();
+    }
+
+    void report(const char* name, const char* input, bool ok, bool matches, double seconds, size_t raw_size,
+                double baseline) {
+        if (!ok) {
+            printf("%-22s %-5s failed\n", name, input);
+            return;
+        }
+
+        const double rate = static_cast<double>(raw_size) / seconds / (1024.0 * 1024.0);
+        printf("%-22s %-5s %9.1f MB/s", name, input, rate);
+        if (baseline > 0.0) {
+            printf("  %5.2fx", baseline / seconds);
+        }
+        printf("%s\n", matches ? "" : "  OUTPUT MISMATCH");
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t megabytes = argc > 1 ? static_cast<size_t>(std::max(1, atoi(argv[1]))) : 16;
+    const std::vector<unsigned char> raw = make_obj(megabytes * 1024 * 1024);
+    const std::vector<unsigned char> zlib = deflate_payload(raw, false);
+    const std::vector<unsigned char> gzip = deflate_payload(raw, true);
+    if (zlib.empty() || gzip.empty()) {
+        printf("failed to build the compressed fixtures\n");
+        return 1;
+    }
+
+    printf("payload %zu bytes, zlib %zu, gzip %zu, best of %d, MB/s of decoded output\n", raw.size(), zlib.size(),
+           gzip.size(), repeats);
+
+    std::vector<unsigned char> out;
+    bool ok = true;
+    const double stb_zlib = best_seconds(repeats, [&] {
+        ok = stb_decompress(zlib, out);
+        consume(out.size());
+    });
+    report("stb (old)", "zlib", ok, out == raw, stb_zlib, raw.size(), 0.0);
+
+    // stb rejects the gzip header, this row only records whether it decodes what the cdn serves
+    ok = stb_decompress(gzip, out);
+    printf("%-22s %-5s %s\n", "stb (old)", "gzip", ok && out == raw ? "decoded" : "failed");
+
+    for (const auto& [input, data] : {std::make_pair("zlib", &zlib), std::make_pair("gzip", &gzip)}) {
+        const double seconds = best_seconds(repeats, [&, data = data] {
+            c_pooled_buffer buffer(raw.size());
+            ok = decompress(data->data(), data->size(), buffer.data());
+            consume(buffer.data().size());
+        });
+        ok = ok && decompress(data->data(), data->size(), out);
+        report("decompress (pooled)", input, ok, out == raw, seconds, raw.size(), stb_zlib);
+    }
+
+    for (const auto& [input, data] : {std::make_pair("zlib", &zlib), std::make_pair("gzip", &gzip)}) {
+        const double seconds = best_seconds(repeats, [&, data = data] {
+            ok = stream_decompress(*data, out);
+            consume(out.size());
+        });
+        report("c_inflate_stream", input, ok, out == raw, seconds, raw.size(), stb_zlib);
+    }
+    return 0;
+}
@@ -0,0 +1,298 @@
+// avatar download time through c_http_client against the old serial curl_easy path, served by a local stand-in
+// for the cdn that adds latency to every request (posix sockets, so linux and macos only)
+// build from the repository root (curl.h is included unqualified, -I the directory that holds it):
+//   g++ -O2 -std=c++17 -I/usr/include/curl bench/http_bench.cpp net/http_client.cpp compression/inflate_stream.cpp
+//       compression/decompress.cpp jobs/job_system.cpp -lcurl -lz -lpthread -o http_bench
+// usage: http_bench [request latency ms, default 40] [new connection latency ms, default 2x request] [rounds, default 5]
+#include "../net/http_client.hpp"
+#include "bench_common.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    // what one avatar load fetches: the obj, the mtl, its textures and the face
+    struct c_fixture {
+        std::string path;
+        size_t size;
+    };
+
+    const c_fixture fixtures[] = {
+        {"/avatar.obj", 2 * 1024 * 1024}, {"/avatar.mtl", 4 * 1024},  {"/tex0", 256 * 1024}, {"/tex1", 256 * 1024},
+        {"/tex2", 128 * 1024},            {"/tex3", 128 * 1024},      {"/tex4", 64 * 1024},   {"/tex5", 64 * 1024},
+        {"/tex6", 32 * 1024},             {"/tex7", 32 * 1024},       {"/face", 64 * 1024},
+    };
+
+    // http/1.1 keep-alive server on a loopback port, one thread per connection. every response waits
+    // request_latency first, the first one on a connection also waits connect_latency for the handshakes a
+    // real cdn connection costs
+    class c_fixture_server {
+    public:
+        c_fixture_server(int request_latency_ms, int connect_latency_ms)
+            : request_latency_(request_latency_ms), connect_latency_(connect_latency_ms) {
+            c_bench_random random;
+            for (const auto& fixture : fixtures) {
+                std::string body(fixture.size, '\0');
+                for (auto& byte : body) {
+                    byte = static_cast<char>('a' + random.next() % 26);
+                }
+                files_[fixture.path] = std::move(body);
+            }
+        }
+
+        ~c_fixture_server() {
+            if (listener_ < 0) {
+                return;
+            }
+
+            // wakes accept and every recv, then waits for the threads before the files go away
+            shutdown(listener_, SHUT_RDWR);
+            if (acceptor_.joinable()) {
+                acceptor_.join();
+            }
+            close(listener_);
+            for (const int client : clients_) {
+                shutdown(client, SHUT_RDWR);
+            }
+            for (auto& worker : workers_) {
+                worker.join();
+            }
+            for (const int client : clients_) {
+                close(client);
+            }
+        }
+
+        // port the server listens on, 0 when it couldn't start
+        int start() {
+            listener_ = socket(AF_INET, SOCK_STREAM, 0);
+            if (listener_ < 0) {
+                return 0;
+            }
+
+            const int reuse = 1;
+            setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if (bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener_, 64) != 0 ||
+                getsockname(listener_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+                return 0;
+            }
+
+            acceptor_ = std::thread([this] { accept_loop(); });
+            return ntohs(address.sin_port);
+        }
+
+        int connections() const { return connections_.load(); }
+
+    private:
+        void accept_loop() {
+            for (;;) {
+                const int client = accept(listener_, nullptr, nullptr);
+                if (client < 0) {
+                    return;
+                }
+                connections_++;
+                std::lock_guard<std::mutex> lock(mutex_);
+                clients_.push_back(client);
+                workers_.emplace_back([this, client] { serve(client); });
+            }
+        }
+
+        void serve(int client) {
+            const int no_delay = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+            std::string pending;
+            bool first = true;
+            char buffer[4096];
+
+            for (;;) {
+                size_t end = pending.find("\r\n\r\n");
+                while (end == std::string::npos) {
+                    const ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+                    if (received <= 0) {
+                        return;
+                    }
+                    pending.append(buffer, static_cast<size_t>(received));
+                    end = pending.find("\r\n\r\n");
+                }
+
+                const std::string request = pending.substr(0, end);
+                pending.erase(0, end + 4);
+
+                const size_t path_start = request.find(' ') + 1;
+                const std::string path = request.substr(path_start, request.find(' ', path_start) - path_start);
+                const int delay = request_latency_ + (first ? connect_latency_ : 0);
+                first = false;
+                std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+
+                const auto file = files_.find(path);
+                const std::string& body = (file != files_.end()) ? file->second : not_found_;
+                const std::string head = std::string(file != files_.end() ? "HTTP/1.1 200 OK" : "HTTP/1.1 404 Not Found") +
+                    "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nContent-Type: application/octet-stream\r\n\r\n";
+                if (!send_all(client, head.data(), head.size()) || !send_all(client, body.data(), body.size())) {
+                    return;
+                }
+            }
+        }
+
+        static bool send_all(int client, const char* data, size_t size) {
+            while (size > 0) {
+                const ssize_t sent = send(client, data, size, MSG_NOSIGNAL);
+                if (sent <= 0) {
+                    return false;
+                }
+                data += sent;
+                size -= static_cast<size_t>(sent);
+            }
+            return true;
+        }
+
+        std::map<std::string, std::string> files_; // read only once the server runs
+        const std::string not_found_ = "not found";
+        int listener_ = -1;
+        std::thread acceptor_;
+        std::vector<std::thread> workers_; // one per connection, joined with the server
+        std::vector<int> clients_; // closed once their workers are joined
+        std::mutex mutex_;
+        int request_latency_;
+        int connect_latency_;
+        std::atomic<int> connections_{0};
+    };
+
+    size_t curl_collect(void* contents, size_t size, size_t nmemb, void* userp) {
+        auto* buffer = static_cast<std::vector<unsigned char>*>(userp);
+        const auto* bytes = static_cast<const unsigned char*>(contents);
+        buffer->insert(buffer->end(), bytes, bytes + size * nmemb);
+        return size * nmemb;
+    }
+
+    // c_avatar_3d_api::http_get before the transfer engine: a fresh easy handle, and so a fresh connection, per file
+    std::vector<unsigned char> serial_get(const std::string& url) {
+        std::vector<unsigned char> buffer;
+        CURL* curl = curl_easy_init();
+        if (!curl) {
+            return buffer;
+        }
+
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_collect);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 3L);
+        curl_easy_perform(curl);
+        curl_easy_cleanup(curl);
+        return buffer;
+    }
+
+    // bytes of one avatar fetched the old way, one file after another
+    size_t load_serial(const std::string& base) {
+        size_t total = 0;
+        for (const auto& fixture : fixtures) {
+            total += serial_get(base + fixture.path).size();
+        }
+        return total;
+    }
+
+    // one parallel avatar load, shared with the callbacks so none of them outlives what it touches
+    struct c_parallel_load {
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t remaining = std::size(fixtures);
+        std::atomic<size_t> total{0};
+
+        void finish() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0) {
+                cv.notify_all();
+            }
+        }
+    };
+
+    // bytes of one avatar fetched like load_model does now: the obj streamed to a sink, everything else at once
+    size_t load_parallel(const std::string& base) {
+        auto load = std::make_shared<c_parallel_load>();
+
+        for (const auto& fixture : fixtures) {
+            if (fixture.path == "/avatar.obj") {
+                c_http_client::get().get_stream_async(
+                    base + fixture.path,
+                    [load](const unsigned char*, size_t size) {
+                        load->total += size;
+                        return true;
+                    },
+                    [load](bool) { load->finish(); }, false, e_job_priority::high);
+            }
+            else {
+                c_http_client::get().get_async(base + fixture.path, [load](bool, std::vector<unsigned char>&& body) {
+                    load->total += body.size();
+                    load->finish();
+                });
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(load->mutex);
+        load->cv.wait(lock, [&] { return load->remaining == 0; });
+        return load->total.load();
+    }
+}
+
+int main(int argc, char** argv) {
+    const int request_latency = argc > 1 ? std::max(0, atoi(argv[1])) : 40;
+    const int connect_latency = argc > 2 ? std::max(0, atoi(argv[2])) : 2 * request_latency;
+    const int rounds = argc > 3 ? std::max(1, atoi(argv[3])) : 5;
+
+    size_t expected = 0;
+    for (const auto& fixture : fixtures) {
+        expected += fixture.size;
+    }
+
+    c_fixture_server server(request_latency, connect_latency);
+    const int port = server.start();
+    if (port == 0) {
+        printf("failed to start the fixture server\n");
+        return 1;
+    }
+    const std::string base = "http://127.0.0.1:" + std::to_string(port);
+
+    printf("%zu files, %zu bytes per avatar, %d ms per request, %d ms per new connection, %d rounds\n",
+           std::size(fixtures), expected, request_latency, connect_latency, rounds);
+
+    size_t bytes = 0;
+    int connections = server.connections();
+    const double serial = best_seconds(rounds, [&] { bytes = load_serial(base); });
+    printf("%-24s %8.1f ms  %5.1f connections per avatar%s\n", "serial curl_easy (old)", serial * 1000.0,
+           static_cast<double>(server.connections() - connections) / rounds, bytes == expected ? "" : "  SHORT READ");
+
+    // the first load opens the pool's connections, later ones find them idle
+    connections = server.connections();
+    const double cold = best_seconds(1, [&] { bytes = load_parallel(base); });
+    printf("%-24s %8.1f ms  %5.1f connections  %5.2fx%s\n", "c_http_client cold", cold * 1000.0,
+           static_cast<double>(server.connections() - connections), serial / cold, bytes == expected ? "" : "  SHORT READ");
+
+    connections = server.connections();
+    const double warm = best_seconds(rounds, [&] { bytes = load_parallel(base); });
+    printf("%-24s %8.1f ms  %5.1f connections per avatar  %5.2fx%s\n", "c_http_client warm", warm * 1000.0,
+           static_cast<double>(server.connections() - connections) / rounds, serial / warm,
+           bytes == expected ? "" : "  SHORT READ");
+    return 0;
+}
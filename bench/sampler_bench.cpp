@@ -0,0 +1,116 @@
+// sample_texture_batch against per-pixel c_decoded_texture::sample: accuracy and throughput
+// build from the repository root:
+//   g++ -O2 -std=c++17 bench/sampler_bench.cpp texture/texture_cache.cpp texture/texture_sampler.cpp
+//       cache/texture_disk_cache.cpp cache/mapped_file.cpp jobs/job_system.cpp -lpthread -o sampler_bench
+// usage: sampler_bench [texture size, default 512]
+#define STB_IMAGE_IMPLEMENTATION
+#include "../../ext/imgui/stb_image.h"
+
+#include "../texture/texture_cache.hpp"
+#include "../texture/texture_sampler.hpp"
+#include "bench_common.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace {
+    constexpr int repeats = 7;
+    constexpr size_t sample_count = 1 << 20;
+    constexpr size_t batch_sizes[] = {4, 8, 16, 64};
+
+    const char* isa_name(e_sampler_isa isa) {
+        switch (isa) {
+        case e_sampler_isa::avx2:
+            return "avx2";
+        case e_sampler_isa::sse41:
+            return "sse4.1";
+        default:
+            return "scalar";
+        }
+    }
+
+    std::unique_ptr<c_decoded_texture> make_texture(int size) {
+        c_bench_random random;
+        std::vector<unsigned char> pixels(static_cast<size_t>(size) * size * 4);
+        for (auto& texel : pixels) {
+            texel = static_cast<unsigned char>(random.next());
+        }
+
+        auto texture = std::make_unique<c_decoded_texture>();
+        texture->pixels = c_texel_buffer::from_vector(std::move(pixels));
+        texture->width = texture->source_width = size;
+        texture->height = texture->source_height = size;
+        texture->update_metrics();
+        texture->ready.store(true, std::memory_order_release);
+        return texture;
+    }
+
+    inline uint32_t pack_unit(float r, float g, float b, float a) {
+        return static_cast<uint32_t>(r * 255.0f + 0.5f) | (static_cast<uint32_t>(g * 255.0f + 0.5f) << 8) |
+            (static_cast<uint32_t>(b * 255.0f + 0.5f) << 16) | (static_cast<uint32_t>(a * 255.0f + 0.5f) << 24);
+    }
+
+    // the textured-pixel path before the batch api: one sample per pixel, floats packed back into rgba8
+    void sample_scalar(const c_decoded_texture& texture, const float* u, const float* v, size_t count, uint32_t* out) {
+        for (size_t i = 0; i < count; i++) {
+            float r, g, b, a;
+            texture.sample(u[i], v[i], r, g, b, a);
+            out[i] = pack_unit(r, g, b, a);
+        }
+    }
+
+    int max_channel_difference(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        int worst = 0;
+        for (size_t i = 0; i < a.size(); i++) {
+            for (int shift = 0; shift < 32; shift += 8) {
+                const int difference = std::abs(static_cast<int>((a[i] >> shift) & 0xFF) - static_cast<int>((b[i] >> shift) & 0xFF));
+                worst = std::max(worst, difference);
+            }
+        }
+        return worst;
+    }
+}
+
+int main(int argc, char** argv) {
+    const int size = argc > 1 ? std::max(2, atoi(argv[1])) : 512;
+    const auto texture = make_texture(size);
+
+    // spans of neighbouring pixels like the rasterizer produces, with a slight slant and some clamped edges
+    c_bench_random random;
+    std::vector<float> u(sample_count), v(sample_count);
+    for (size_t i = 0; i < sample_count; i += 64) {
+        const float u0 = random.unit() * 1.1f - 0.05f;
+        const float v0 = random.unit() * 1.1f - 0.05f;
+        const float du = (random.unit() - 0.5f) * 4.0f / static_cast<float>(size);
+        const float dv = (random.unit() - 0.5f) * 1.0f / static_cast<float>(size);
+        for (size_t j = 0; j < 64 && i + j < sample_count; j++) {
+            u[i + j] = u0 + du * static_cast<float>(j);
+            v[i + j] = v0 + dv * static_cast<float>(j);
+        }
+    }
+
+    std::vector<uint32_t> reference(sample_count), batch(sample_count);
+    const double scalar_seconds = best_seconds(repeats, [&] {
+        sample_scalar(*texture, u.data(), v.data(), sample_count, reference.data());
+        consume(reference[sample_count / 2]);
+    });
+
+    printf("%dx%d rgba8, %zu samples, isa %s, best of %d\n", size, size, sample_count, isa_name(sampler_isa()), repeats);
+    printf("%-16s %10.1f Mpixels/s\n", "sample (scalar)", sample_count / scalar_seconds / 1e6);
+
+    for (const size_t batch_size : batch_sizes) {
+        const double seconds = best_seconds(repeats, [&] {
+            for (size_t i = 0; i < sample_count; i += batch_size) {
+                sample_texture_batch(*texture, 0, u.data() + i, v.data() + i, std::min(batch_size, sample_count - i),
+                                     batch.data() + i);
+            }
+            consume(batch[sample_count / 2]);
+        });
+
+        printf("batch of %-7zu %10.1f Mpixels/s  %5.2fx  max channel difference %d\n", batch_size,
+               sample_count / seconds / 1e6, scalar_seconds / seconds, max_channel_difference(reference, batch));
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+// texel fetch throughput of the linear and tiled layouts for rotated-triangle access
+// build from the repository root:
+//   g++ -O2 -std=c++17 bench/texel_layout_bench.cpp texture/texture_cache.cpp texture/texture_sampler.cpp
+//       cache/texture_disk_cache.cpp cache/mapped_file.cpp jobs/job_system.cpp -lpthread -o texel_layout_bench
+// usage: texel_layout_bench [texture size, default 1024]
+#define STB_IMAGE_IMPLEMENTATION
+#include "../../ext/imgui/stb_image.h"
+
+#include "../texture/texture_cache.hpp"
+#include "../texture/texture_sampler.hpp"
+#include "bench_common.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace {
+    constexpr int repeats = 5;
+    constexpr int batch_size = 64; // a scanline span, what the rasterizer hands the batch sampler
+    constexpr float uv_scale = 0.7f; // keeps the rotated square inside the texture at every angle
+
+    std::unique_ptr<c_decoded_texture> make_texture(int size, e_texel_layout layout) {
+        c_bench_random random;
+        std::vector<unsigned char> pixels(static_cast<size_t>(size) * size * 4);
+        for (auto& texel : pixels) {
+            texel = static_cast<unsigned char>(random.next());
+        }
+
+        auto texture = std::make_unique<c_decoded_texture>();
+        texture->pixels = c_texel_buffer::from_vector(std::move(pixels));
+        texture->width = texture->source_width = size;
+        texture->height = texture->source_height = size;
+        texture->update_metrics();
+        if (layout == e_texel_layout::tiled) {
+            texture->convert_to_tiled();
+        }
+        texture->ready.store(true, std::memory_order_release);
+        return texture;
+    }
+
+    // screen-space right triangle covering half a size x size target at 1:1 magnification, its uvs rotated by
+    // angle around the texture centre. every row of the triangle walks the texture along the rotated x axis,
+    // at 90 degrees that is straight down a column of a linear image
+    template <typename t_span>
+    void scan_triangle(int size, float angle, const t_span& span) {
+        const float cos_a = std::cos(angle) * uv_scale / static_cast<float>(size);
+        const float sin_a = std::sin(angle) * uv_scale / static_cast<float>(size);
+        const float half = 0.5f * static_cast<float>(size);
+
+        for (int y = 0; y < size; y++) {
+            const float dy = static_cast<float>(y) + 0.5f - half;
+            const float u0 = 0.5f + (-half + 0.5f) * cos_a - dy * sin_a;
+            const float v0 = 0.5f + (-half + 0.5f) * sin_a + dy * cos_a;
+            span(size - y, u0, v0, cos_a, sin_a);
+        }
+    }
+
+    uint64_t run_scalar(const c_decoded_texture& texture, int size, float angle) {
+        uint64_t sum = 0;
+        scan_triangle(size, angle, [&](int count, float u, float v, float du, float dv) {
+            for (int x = 0; x < count; x++, u += du, v += dv) {
+                float r, g, b, a;
+                texture.sample(u, v, r, g, b, a);
+                sum += static_cast<uint64_t>((r + g + b + a) * 255.0f);
+            }
+        });
+        return sum;
+    }
+
+    uint64_t run_batch(const c_decoded_texture& texture, int size, float angle) {
+        uint64_t sum = 0;
+        float us[batch_size], vs[batch_size];
+        uint32_t out[batch_size];
+        scan_triangle(size, angle, [&](int count, float u, float v, float du, float dv) {
+            for (int x = 0; x < count; x += batch_size) {
+                const int n = std::min(batch_size, count - x);
+                for (int i = 0; i < n; i++, u += du, v += dv) {
+                    us[i] = u;
+                    vs[i] = v;
+                }
+                sample_texture_batch(texture, 0, us, vs, static_cast<size_t>(n), out);
+                for (int i = 0; i < n; i++) {
+                    sum += out[i];
+                }
+            }
+        });
+        return sum;
+    }
+}
+
+int main(int argc, char** argv) {
+    const int size = argc > 1 ? std::max(16, atoi(argv[1])) : 1024;
+    const auto linear = make_texture(size, e_texel_layout::linear);
+    const auto tiled = make_texture(size, e_texel_layout::tiled);
+    const double texels = 0.5 * static_cast<double>(size) * (size + 1);
+
+    printf("%dx%d rgba8, %.0f texels per triangle, best of %d, Mtexels/s\n", size, size, texels, repeats);
+    printf("%-8s %-7s %10s %10s %8s\n", "angle", "path", "linear", "tiled", "tiled/lin");
+
+    static constexpr float angles[] = {0.0f, 30.0f, 45.0f, 60.0f, 90.0f, 135.0f};
+    for (const float degrees : angles) {
+        const float angle = degrees * 3.14159265f / 180.0f;
+        const struct {
+            const char* name;
+            uint64_t (*run)(const c_decoded_texture&, int, float);
+        } paths[] = {{"sample", run_scalar}, {"batch", run_batch}};
+
+        for (const auto& path : paths) {
+            uint64_t sums[2] = {0, 0};
+            const double linear_seconds = best_seconds(repeats, [&] { sums[0] = path.run(*linear, size, angle); });
+            const double tiled_seconds = best_seconds(repeats, [&] { sums[1] = path.run(*tiled, size, angle); });
+            consume(sums[0] + sums[1]);
+
+            printf("%-8.0f %-7s %10.1f %10.1f %7.2fx%s\n", degrees, path.name, texels / linear_seconds / 1e6,
+                   texels / tiled_seconds / 1e6, linear_seconds / tiled_seconds,
+                   sums[0] == sums[1] ? "" : "  LAYOUTS DISAGREE");
+        }
+    }
+    return 0;
+}
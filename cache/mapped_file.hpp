@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// read-only memory mapping of a whole file
+class c_mapped_file {
+public:
+    c_mapped_file() = default;
+    ~c_mapped_file();
+
+    c_mapped_file(const c_mapped_file&) = delete;
+    c_mapped_file& operator=(const c_mapped_file&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool is_open() const { return data_ != nullptr; }
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// writes to a temporary sibling and renames it over path, so readers never observe a partial file
+bool write_file_atomic(const std::string& path, const void* data, size_t size);
+
+// cheap integrity check for cache files, catches torn or corrupted payloads rather than tampering
+uint64_t checksum64(const unsigned char* data, size_t size);
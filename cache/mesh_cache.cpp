@@ -0,0 +1,340 @@
+#include "mesh_cache.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<c_obj_vertex>, "c_obj_vertex is written verbatim");
+static_assert(std::is_trivially_copyable_v<c_obj_corner>, "c_obj_corner is written verbatim");
+static_assert(std::is_trivially_copyable_v<c_obj_normal>, "c_obj_normal is written verbatim");
+static_assert(std::is_trivially_copyable_v<c_obj_submesh>, "c_obj_submesh is written verbatim");
+
+struct c_mesh_file_string {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+// one record per material id, names are shared with the material name section
+struct c_mesh_file_material {
+    c_mesh_file_string diffuse_texture;
+    float diffuse[3];
+    float ambient[3];
+    float specular[3];
+    float shininess;
+    float sampled_color[3];
+    int32_t texture_index;
+    int32_t defined;
+};
+
+// sections follow the header in this order: vertices, tex coords, corners, normals,
+// submeshes, material names, materials, string blob
+struct c_mesh_file_header {
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t source_key = 0;
+    uint64_t checksum = 0;
+    uint64_t payload_size = 0;
+    uint32_t vertex_count = 0;
+    uint32_t tex_coord_count = 0;
+    uint32_t corner_count = 0;
+    uint32_t face_count = 0;
+    uint32_t submesh_count = 0;
+    uint32_t material_name_count = 0;
+    uint32_t material_count = 0;
+    uint32_t string_bytes = 0;
+    float bounds_min[3] = {0.0f, 0.0f, 0.0f};
+    float bounds_max[3] = {0.0f, 0.0f, 0.0f};
+};
+
+static uint64_t payload_size_for(const c_mesh_file_header& header) {
+    return static_cast<uint64_t>(header.vertex_count) * sizeof(c_obj_vertex) +
+        static_cast<uint64_t>(header.tex_coord_count) * sizeof(c_obj_vertex) +
+        static_cast<uint64_t>(header.corner_count) * sizeof(c_obj_corner) +
+        static_cast<uint64_t>(header.face_count) * sizeof(c_obj_normal) +
+        static_cast<uint64_t>(header.submesh_count) * sizeof(c_obj_submesh) +
+        static_cast<uint64_t>(header.material_name_count) * sizeof(c_mesh_file_string) +
+        static_cast<uint64_t>(header.material_count) * sizeof(c_mesh_file_material) +
+        header.string_bytes;
+}
+
+template <typename t_value>
+static void append_pod(std::vector<unsigned char>& buffer, const t_value* values, size_t count) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+    buffer.insert(buffer.end(), bytes, bytes + count * sizeof(t_value));
+}
+
+template <typename t_value>
+static void read_pod(const unsigned char*& cursor, std::vector<t_value>& out, size_t count) {
+    out.resize(count);
+    if (count > 0) {
+        std::memcpy(out.data(), cursor, count * sizeof(t_value));
+    }
+    cursor += count * sizeof(t_value);
+}
+
+static c_mesh_file_string add_string(std::string& blob, const std::string& value) {
+    c_mesh_file_string ref;
+    ref.offset = static_cast<uint32_t>(blob.size());
+    ref.length = static_cast<uint32_t>(value.size());
+    blob += value;
+    return ref;
+}
+
+static bool read_string(const char* blob, uint32_t blob_size, const c_mesh_file_string& ref, std::string& out) {
+    if (ref.offset > blob_size || ref.length > blob_size - ref.offset) {
+        return false;
+    }
+    out.assign(blob + ref.offset, ref.length);
+    return true;
+}
+
+void c_mesh_cache::initialize(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (directory.empty()) {
+        std::error_code error;
+        std::filesystem::path temp = std::filesystem::temp_directory_path(error);
+        directory_ = error ? std::string() : (temp / "avatar_3d_cache" / "meshes").string();
+    }
+    else {
+        directory_ = directory;
+    }
+
+    if (!directory_.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(directory_, error);
+    }
+}
+
+std::string c_mesh_cache::entry_path(const std::string& obj_hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (directory_.empty() || obj_hash.empty()) {
+        return "";
+    }
+
+    std::string name;
+    name.reserve(obj_hash.size());
+    for (char c : obj_hash) {
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '_') {
+            name += c;
+        }
+    }
+
+    return name.empty() ? "" : (std::filesystem::path(directory_) / (name + ".mesh")).string();
+}
+
+uint64_t c_mesh_cache::make_source_key(const std::string& mtl_hash, const std::vector<std::string>& texture_hashes) {
+    uint64_t hash = 0xCBF29CE484222325ULL ^ format_version;
+    auto mix = [&hash](const std::string& value) {
+        for (unsigned char c : value) {
+            hash = (hash ^ c) * 0x100000001B3ULL;
+        }
+        hash = (hash ^ '\n') * 0x100000001B3ULL;
+    };
+
+    mix(mtl_hash);
+    for (const auto& texture_hash : texture_hashes) {
+        mix(texture_hash);
+    }
+    return hash;
+}
+
+bool c_mesh_cache::store(const std::string& obj_hash, uint64_t source_key, size_t texture_count, const c_obj_model& model) {
+    std::string path = entry_path(obj_hash);
+    if (path.empty() || !model.valid) {
+        return false;
+    }
+
+    constexpr size_t max_count = std::numeric_limits<uint32_t>::max();
+    if (model.vertices.size() > max_count || model.tex_coords.size() > max_count || model.mesh.indices.size() > max_count) {
+        return false;
+    }
+
+    c_mesh_file_header header;
+    header.magic = format_magic;
+    header.version = format_version;
+    header.source_key = source_key;
+    header.vertex_count = static_cast<uint32_t>(model.vertices.size());
+    header.tex_coord_count = static_cast<uint32_t>(model.tex_coords.size());
+    header.corner_count = static_cast<uint32_t>(model.mesh.indices.size());
+    header.face_count = static_cast<uint32_t>(model.mesh.normals.size());
+    header.submesh_count = static_cast<uint32_t>(model.mesh.submeshes.size());
+    header.material_name_count = static_cast<uint32_t>(model.mesh.material_names.size());
+    header.material_count = static_cast<uint32_t>(model.materials.size());
+
+    if (!model.vertices.empty()) {
+        for (int axis = 0; axis < 3; axis++) {
+            header.bounds_min[axis] = std::numeric_limits<float>::max();
+            header.bounds_max[axis] = -std::numeric_limits<float>::max();
+        }
+        for (const auto& v : model.vertices) {
+            const float position[3] = {v.x, v.y, v.z};
+            for (int axis = 0; axis < 3; axis++) {
+                header.bounds_min[axis] = std::min(header.bounds_min[axis], position[axis]);
+                header.bounds_max[axis] = std::max(header.bounds_max[axis], position[axis]);
+            }
+        }
+    }
+
+    std::string strings;
+    std::vector<c_mesh_file_string> material_names;
+    material_names.reserve(model.mesh.material_names.size());
+    for (const auto& name : model.mesh.material_names) {
+        material_names.push_back(add_string(strings, name));
+    }
+
+    std::vector<c_mesh_file_material> materials;
+    materials.reserve(model.materials.size());
+    for (const auto& material : model.materials) {
+        c_mesh_file_material record;
+        record.diffuse_texture = add_string(strings, material.diffuse_texture);
+        std::copy_n(material.diffuse, 3, record.diffuse);
+        std::copy_n(material.ambient, 3, record.ambient);
+        std::copy_n(material.specular, 3, record.specular);
+        std::copy_n(material.sampled_color, 3, record.sampled_color);
+        record.shininess = material.shininess;
+        // maps with no matching texture hash resolve to nothing, load rejects indices past the list
+        record.texture_index = (material.texture_index >= 0 && static_cast<size_t>(material.texture_index) < texture_count) ?
+            material.texture_index : -1;
+        record.defined = material.defined ? 1 : 0;
+        materials.push_back(record);
+    }
+    header.string_bytes = static_cast<uint32_t>(strings.size());
+    header.payload_size = payload_size_for(header);
+
+    std::vector<unsigned char> buffer;
+    buffer.reserve(sizeof(header) + header.payload_size);
+    append_pod(buffer, &header, 1);
+    append_pod(buffer, model.vertices.data(), model.vertices.size());
+    append_pod(buffer, model.tex_coords.data(), model.tex_coords.size());
+    append_pod(buffer, model.mesh.indices.data(), model.mesh.indices.size());
+    append_pod(buffer, model.mesh.normals.data(), model.mesh.normals.size());
+    append_pod(buffer, model.mesh.submeshes.data(), model.mesh.submeshes.size());
+    append_pod(buffer, material_names.data(), material_names.size());
+    append_pod(buffer, materials.data(), materials.size());
+    append_pod(buffer, strings.data(), strings.size());
+
+    header.checksum = checksum64(buffer.data() + sizeof(header), buffer.size() - sizeof(header));
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    return write_file_atomic(path, buffer.data(), buffer.size());
+}
+
+bool c_mesh_cache::load(const std::string& obj_hash, uint64_t source_key, size_t texture_count, c_obj_model& model,
+                        c_mesh_bounds* bounds) {
+    std::string path = entry_path(obj_hash);
+    if (path.empty()) {
+        return false;
+    }
+
+    c_mapped_file file;
+    if (!file.open(path)) {
+        return false;
+    }
+
+    // anything that does not validate is treated as a miss and removed so the caller rebuilds it
+    auto reject = [&]() {
+        file.close();
+        remove(obj_hash);
+        return false;
+    };
+
+    c_mesh_file_header header;
+    if (file.size() < sizeof(header)) {
+        return reject();
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (header.magic != format_magic || header.version != format_version || header.source_key != source_key) {
+        return reject();
+    }
+
+    const unsigned char* payload = file.data() + sizeof(header);
+    if (header.payload_size != file.size() - sizeof(header) ||
+        header.payload_size != payload_size_for(header) ||
+        header.corner_count != static_cast<uint64_t>(header.face_count) * 3 ||
+        header.material_count != header.material_name_count ||
+        header.checksum != checksum64(payload, static_cast<size_t>(header.payload_size))) {
+        return reject();
+    }
+
+    c_obj_model loaded;
+    const unsigned char* cursor = payload;
+    read_pod(cursor, loaded.vertices, header.vertex_count);
+    read_pod(cursor, loaded.tex_coords, header.tex_coord_count);
+    read_pod(cursor, loaded.mesh.indices, header.corner_count);
+    read_pod(cursor, loaded.mesh.normals, header.face_count);
+    read_pod(cursor, loaded.mesh.submeshes, header.submesh_count);
+
+    std::vector<c_mesh_file_string> material_names;
+    std::vector<c_mesh_file_material> materials;
+    read_pod(cursor, material_names, header.material_name_count);
+    read_pod(cursor, materials, header.material_count);
+    const char* strings = reinterpret_cast<const char*>(cursor);
+
+    // the checksum only catches accidental damage, every index read from the file is range checked too
+    for (const auto& corner : loaded.mesh.indices) {
+        if (corner.position < 0 || static_cast<uint32_t>(corner.position) >= header.vertex_count ||
+            corner.texcoord < -1 || (corner.texcoord >= 0 && static_cast<uint32_t>(corner.texcoord) >= header.tex_coord_count)) {
+            return reject();
+        }
+    }
+
+    for (const auto& submesh : loaded.mesh.submeshes) {
+        if (submesh.material_id < -1 || submesh.material_id >= static_cast<int>(header.material_name_count) ||
+            submesh.first_face > header.face_count || submesh.face_count > header.face_count - submesh.first_face) {
+            return reject();
+        }
+    }
+
+    loaded.mesh.material_names.resize(material_names.size());
+    for (size_t i = 0; i < material_names.size(); i++) {
+        if (!read_string(strings, header.string_bytes, material_names[i], loaded.mesh.material_names[i])) {
+            return reject();
+        }
+        loaded.material_ids.emplace(loaded.mesh.material_names[i], static_cast<int>(i));
+    }
+
+    loaded.materials.reserve(materials.size());
+    for (const auto& record : materials) {
+        if (record.texture_index < -1 || (record.texture_index >= 0 && static_cast<size_t>(record.texture_index) >= texture_count)) {
+            return reject();
+        }
+
+        c_obj_material material;
+        if (!read_string(strings, header.string_bytes, record.diffuse_texture, material.diffuse_texture)) {
+            return reject();
+        }
+        std::copy_n(record.diffuse, 3, material.diffuse);
+        std::copy_n(record.ambient, 3, material.ambient);
+        std::copy_n(record.specular, 3, material.specular);
+        std::copy_n(record.sampled_color, 3, material.sampled_color);
+        material.shininess = record.shininess;
+        material.texture_index = record.texture_index;
+        material.defined = record.defined != 0;
+        loaded.materials.push_back(std::move(material));
+    }
+
+    build_render_mesh(loaded);
+    loaded.valid = !loaded.vertices.empty() && loaded.mesh.face_count() > 0;
+    if (!loaded.valid) {
+        return reject();
+    }
+
+    if (bounds) {
+        std::copy_n(header.bounds_min, 3, bounds->min);
+        std::copy_n(header.bounds_max, 3, bounds->max);
+    }
+
+    model = std::move(loaded);
+    return true;
+}
+
+void c_mesh_cache::remove(const std::string& obj_hash) {
+    std::string path = entry_path(obj_hash);
+    if (!path.empty()) {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+}
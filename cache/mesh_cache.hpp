@@ -0,0 +1,44 @@
+#pragma once
+#include "../parsers/obj_parser.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct c_mesh_bounds {
+    float min[3] = {0.0f, 0.0f, 0.0f};
+    float max[3] = {0.0f, 0.0f, 0.0f};
+};
+
+// disk cache of compiled (already parsed) avatar meshes, one file per obj hash. cdn content is
+// immutable per hash, so an entry only goes stale through a format bump or a different mtl/texture set,
+// which source_key captures. entries are memory-mapped and copied section by section, no text parsing
+class c_mesh_cache {
+public:
+    static c_mesh_cache& get() {
+        static c_mesh_cache instance;
+        return instance;
+    }
+
+    // empty directory selects <temp>/avatar_3d_cache/meshes
+    void initialize(const std::string& directory = "");
+
+    // texture_count is the size of the avatar's texture list, material texture indices must fall inside it
+    bool load(const std::string& obj_hash, uint64_t source_key, size_t texture_count, c_obj_model& model,
+              c_mesh_bounds* bounds = nullptr);
+    bool store(const std::string& obj_hash, uint64_t source_key, size_t texture_count, const c_obj_model& model);
+    void remove(const std::string& obj_hash);
+
+    static uint64_t make_source_key(const std::string& mtl_hash, const std::vector<std::string>& texture_hashes);
+
+private:
+    c_mesh_cache() = default;
+
+    std::string entry_path(const std::string& obj_hash);
+
+    std::string directory_;
+    std::mutex mutex_;
+
+    static constexpr uint32_t format_magic = 0x4D584252; // "RBXM"
+    static constexpr uint32_t format_version = 2;
+};
@@ -0,0 +1,345 @@
+#include "texture_disk_cache.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+// every section starts on a cache line so mapped levels are as aligned as allocated ones
+static constexpr uint64_t section_alignment = 64;
+static constexpr int max_level_count = 32;
+
+struct c_texture_file_level {
+    int32_t width = 0;
+    int32_t height = 0;
+    uint64_t offset = 0; // from the start of the file
+    uint64_t size = 0;
+};
+
+// the level records (base image first) follow the header, then the palette and the levels themselves
+struct c_texture_file_header {
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t checksum = 0;
+    uint64_t payload_size = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t source_width = 0;
+    int32_t source_height = 0;
+    uint32_t format = 0;
+    uint32_t layout = 0;
+    uint32_t level_count = 0;
+    uint32_t palette_bytes = 0;
+    uint64_t palette_offset = 0;
+};
+
+static uint64_t align_section(uint64_t offset) {
+    return (offset + section_alignment - 1) & ~(section_alignment - 1);
+}
+
+// bytes one level of the given size takes in memory, tiled levels are padded to whole blocks
+static uint64_t level_size_for(e_texel_format format, e_texel_layout layout, int width, int height) {
+    const uint64_t texels = static_cast<uint64_t>(width) * height;
+    const uint64_t blocks = static_cast<uint64_t>((width + 3) >> 2) * ((height + 3) >> 2);
+    switch (format) {
+    case e_texel_format::palette:
+        return texels;
+    case e_texel_format::bc1:
+        return blocks * 8;
+    default:
+        return (layout == e_texel_layout::tiled) ? blocks * 64 : texels * 4;
+    }
+}
+
+void c_texture_disk_cache::initialize(const std::string& directory, size_t max_size_mb) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (directory.empty()) {
+            std::error_code error;
+            std::filesystem::path temp = std::filesystem::temp_directory_path(error);
+            directory_ = error ? std::string() : (temp / "avatar_3d_cache" / "textures").string();
+        }
+        else {
+            directory_ = directory;
+        }
+
+        if (!directory_.empty()) {
+            std::error_code error;
+            std::filesystem::create_directories(directory_, error);
+
+            // temporaries of writes a crash interrupted before their rename
+            for (std::filesystem::directory_iterator it(directory_, error), end; !error && it != end; it.increment(error)) {
+                if (it->path().filename().string().find(".tex.tmp") != std::string::npos) {
+                    std::error_code remove_error;
+                    std::filesystem::remove(it->path(), remove_error);
+                }
+            }
+        }
+    }
+
+    max_size_.store((max_size_mb > 0 ? max_size_mb : default_max_size_mb) * 1024 * 1024, std::memory_order_relaxed);
+    trim();
+}
+
+std::string c_texture_disk_cache::entry_path(const std::string& content_key, const c_texture_decode_settings& settings) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (directory_.empty() || content_key.empty()) {
+        return "";
+    }
+
+    std::string name;
+    name.reserve(content_key.size() + 16);
+    for (char c : content_key) {
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '_') {
+            name += c;
+        }
+    }
+    if (name.empty()) {
+        return "";
+    }
+
+    // '.' never survives the sanitizing above, so the settings suffix can't make two keys collide
+    name += "." + std::to_string(settings.max_dimension) + "." +
+        std::to_string(static_cast<int>(settings.compression)) + std::to_string(static_cast<int>(settings.layout));
+    return (std::filesystem::path(directory_) / (name + ".tex")).string();
+}
+
+bool c_texture_disk_cache::store(const std::string& content_key, const c_texture_decode_settings& settings,
+                                 const c_decoded_texture& texture) {
+    std::string path = entry_path(content_key, settings);
+    if (path.empty() || texture.pixels.empty() || texture.width <= 0 || texture.height <= 0 ||
+        texture.mips.size() + 1 > max_level_count) {
+        return false;
+    }
+
+    c_texture_file_header header;
+    header.magic = format_magic;
+    header.version = format_version;
+    header.width = texture.width;
+    header.height = texture.height;
+    header.source_width = texture.source_width;
+    header.source_height = texture.source_height;
+    header.format = static_cast<uint32_t>(texture.format);
+    header.layout = static_cast<uint32_t>(texture.layout);
+    header.level_count = static_cast<uint32_t>(texture.mips.size() + 1);
+    header.palette_bytes = static_cast<uint32_t>(texture.palette.size());
+
+    std::vector<const c_texel_buffer*> sources;
+    std::vector<c_texture_file_level> levels(header.level_count);
+    sources.push_back(&texture.pixels);
+    levels[0].width = texture.width;
+    levels[0].height = texture.height;
+    for (size_t i = 0; i < texture.mips.size(); i++) {
+        sources.push_back(&texture.mips[i].pixels);
+        levels[i + 1].width = texture.mips[i].width;
+        levels[i + 1].height = texture.mips[i].height;
+    }
+
+    uint64_t offset = align_section(sizeof(header) + levels.size() * sizeof(c_texture_file_level));
+    header.palette_offset = offset;
+    offset = align_section(offset + header.palette_bytes);
+    for (size_t i = 0; i < levels.size(); i++) {
+        levels[i].offset = offset;
+        levels[i].size = sources[i]->size();
+        offset = align_section(offset + levels[i].size);
+    }
+    header.payload_size = offset - sizeof(header);
+
+    std::vector<unsigned char> buffer(static_cast<size_t>(offset));
+    std::memcpy(buffer.data() + sizeof(header), levels.data(), levels.size() * sizeof(c_texture_file_level));
+    if (header.palette_bytes > 0) {
+        std::memcpy(buffer.data() + header.palette_offset, texture.palette.data(), header.palette_bytes);
+    }
+    for (size_t i = 0; i < levels.size(); i++) {
+        std::memcpy(buffer.data() + levels[i].offset, sources[i]->data(), static_cast<size_t>(levels[i].size));
+    }
+
+    header.checksum = checksum64(buffer.data() + sizeof(header), buffer.size() - sizeof(header));
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    std::error_code error;
+    const uintmax_t replaced = std::filesystem::file_size(path, error);
+    if (!write_file_atomic(path, buffer.data(), buffer.size())) {
+        return false;
+    }
+
+    disk_usage_.fetch_add(buffer.size(), std::memory_order_relaxed);
+    if (!error) {
+        disk_usage_.fetch_sub(static_cast<size_t>(replaced), std::memory_order_relaxed);
+    }
+    if (disk_usage_.load(std::memory_order_relaxed) > max_size_.load(std::memory_order_relaxed)) {
+        trim();
+    }
+    return true;
+}
+
+bool c_texture_disk_cache::load(const std::string& content_key, const c_texture_decode_settings& settings,
+                                c_decoded_texture& texture) {
+    std::string path = entry_path(content_key, settings);
+    if (path.empty()) {
+        return false;
+    }
+
+    // shared by every level, the mapping is unmapped with the last of them
+    auto file = std::make_shared<c_mapped_file>();
+    if (!file->open(path)) {
+        return false;
+    }
+
+    // anything that does not validate is treated as a miss and removed so the caller decodes it again
+    auto reject = [&]() {
+        file->close();
+        remove(content_key, settings);
+        return false;
+    };
+
+    c_texture_file_header header;
+    if (file->size() < sizeof(header)) {
+        return reject();
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (header.magic != format_magic || header.version != format_version ||
+        header.format > static_cast<uint32_t>(e_texel_format::bc1) ||
+        header.layout > static_cast<uint32_t>(e_texel_layout::tiled) ||
+        header.level_count == 0 || header.level_count > max_level_count ||
+        header.payload_size != file->size() - sizeof(header) ||
+        header.checksum != checksum64(file->data() + sizeof(header), static_cast<size_t>(header.payload_size))) {
+        return reject();
+    }
+
+    const auto format = static_cast<e_texel_format>(header.format);
+    const auto layout = static_cast<e_texel_layout>(header.layout);
+    const bool has_palette = format == e_texel_format::palette;
+    if (header.palette_bytes > 256 * 4 || header.palette_bytes % 4 != 0 || has_palette != (header.palette_bytes > 0) ||
+        header.palette_offset > file->size() || header.palette_bytes > file->size() - header.palette_offset ||
+        sizeof(header) + header.level_count * sizeof(c_texture_file_level) > file->size()) {
+        return reject();
+    }
+
+    std::vector<c_texture_file_level> levels(header.level_count);
+    std::memcpy(levels.data(), file->data() + sizeof(header), levels.size() * sizeof(c_texture_file_level));
+
+    // every level has to be exactly what build_mips and the format would have produced, the samplers index
+    // them without bounds checks
+    int expected_width = header.width;
+    int expected_height = header.height;
+    for (const auto& level : levels) {
+        if (level.width != expected_width || level.height != expected_height || level.width <= 0 || level.height <= 0 ||
+            level.size != level_size_for(format, layout, level.width, level.height) ||
+            level.offset % section_alignment != 0 || level.offset > file->size() || level.size > file->size() - level.offset) {
+            return reject();
+        }
+        expected_width = (expected_width > 1) ? expected_width / 2 : 1;
+        expected_height = (expected_height > 1) ? expected_height / 2 : 1;
+    }
+
+    // the mapping is read-only, nothing writes to a published texture's levels
+    auto view = [&file](uint64_t offset, uint64_t size) {
+        return c_texel_buffer(const_cast<unsigned char*>(file->data()) + offset, static_cast<size_t>(size), file);
+    };
+
+    texture.pixels = view(levels[0].offset, levels[0].size);
+    texture.width = header.width;
+    texture.height = header.height;
+    texture.source_width = header.source_width;
+    texture.source_height = header.source_height;
+    texture.channels = 4;
+    texture.update_metrics();
+    texture.layout = layout;
+    texture.format = format;
+    texture.palette = has_palette ? view(header.palette_offset, header.palette_bytes) : c_texel_buffer();
+    texture.mips.clear();
+    for (size_t i = 1; i < levels.size(); i++) {
+        c_texture_mip mip;
+        mip.width = levels[i].width;
+        mip.height = levels[i].height;
+        mip.pixels = view(levels[i].offset, levels[i].size);
+        texture.mips.push_back(std::move(mip));
+    }
+
+    // the modification time doubles as the last use, trim drops the oldest first
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    return true;
+}
+
+void c_texture_disk_cache::remove(const std::string& content_key, const c_texture_decode_settings& settings) {
+    std::string path = entry_path(content_key, settings);
+    if (path.empty()) {
+        return;
+    }
+
+    std::error_code error;
+    const uintmax_t size = std::filesystem::file_size(path, error);
+    if (!error && std::filesystem::remove(path, error)) {
+        disk_usage_.fetch_sub(static_cast<size_t>(size), std::memory_order_relaxed);
+    }
+}
+
+// recounts the directory and drops the least recently used entries until it is back under 3/4 of the cap,
+// so a full cache is not rescanned on every store
+void c_texture_disk_cache::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (directory_.empty()) {
+        return;
+    }
+
+    struct c_disk_entry {
+        std::filesystem::file_time_type last_used;
+        uintmax_t size;
+        std::filesystem::path path;
+    };
+
+    std::vector<c_disk_entry> entries;
+    uintmax_t total = 0;
+    std::error_code error;
+    for (std::filesystem::directory_iterator it(directory_, error), end; !error && it != end; it.increment(error)) {
+        std::error_code entry_error;
+        if (!it->is_regular_file(entry_error)) {
+            continue;
+        }
+
+        const std::filesystem::path& path = it->path();
+        if (path.extension() != ".tex") {
+            continue;
+        }
+
+        const uintmax_t size = it->file_size(entry_error);
+        if (entry_error) {
+            continue;
+        }
+        entries.push_back({it->last_write_time(entry_error), size, path});
+        total += size;
+    }
+
+    const uintmax_t max_size = max_size_.load(std::memory_order_relaxed);
+    if (total > max_size) {
+        std::sort(entries.begin(), entries.end(), [](const c_disk_entry& a, const c_disk_entry& b) {
+            return a.last_used < b.last_used;
+        });
+
+        // a resident texture keeps reading its removed file through the mapping
+        const uintmax_t target = max_size / 4 * 3;
+        for (const auto& entry : entries) {
+            if (total <= target) {
+                break;
+            }
+            std::error_code remove_error;
+            if (std::filesystem::remove(entry.path, remove_error)) {
+                total -= entry.size;
+            }
+        }
+    }
+
+    disk_usage_.store(static_cast<size_t>(total), std::memory_order_relaxed);
+}
+
+size_t c_texture_disk_cache::get_disk_usage() const {
+    return disk_usage_.load(std::memory_order_relaxed);
+}
+
+size_t c_texture_disk_cache::get_max_size() const {
+    return max_size_.load(std::memory_order_relaxed);
+}
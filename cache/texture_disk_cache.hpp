@@ -0,0 +1,44 @@
+#pragma once
+#include "../texture/texture_cache.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// disk tier behind c_texture_cache: decoded textures exactly as they are resident (downscaled, compressed,
+// tiled, with mips), one file per content hash and settings. a loaded texture's levels point straight into the
+// file mapping, so a warm start neither decodes nor copies. the least recently loaded files are dropped
+// once the directory grows past its size cap
+class c_texture_disk_cache {
+public:
+    static c_texture_disk_cache& get() {
+        static c_texture_disk_cache instance;
+        return instance;
+    }
+
+    // empty directory selects <temp>/avatar_3d_cache/textures, max_size_mb 0 keeps the default cap
+    void initialize(const std::string& directory = "", size_t max_size_mb = 0);
+
+    // fills the texture's levels, format and sizes but leaves publishing it (ready, memory accounting) to the caller
+    bool load(const std::string& content_key, const c_texture_decode_settings& settings, c_decoded_texture& texture);
+    bool store(const std::string& content_key, const c_texture_decode_settings& settings, const c_decoded_texture& texture);
+    void remove(const std::string& content_key, const c_texture_decode_settings& settings);
+
+    size_t get_disk_usage() const;
+    size_t get_max_size() const;
+
+private:
+    c_texture_disk_cache() = default;
+
+    std::string entry_path(const std::string& content_key, const c_texture_decode_settings& settings);
+    void trim();
+
+    std::string directory_;
+    std::mutex mutex_;
+    std::atomic<size_t> disk_usage_{0};
+    std::atomic<size_t> max_size_{default_max_size_mb * 1024 * 1024};
+
+    static constexpr uint32_t format_magic = 0x54584252; // "RBXT"
+    static constexpr uint32_t format_version = 1;
+    static constexpr size_t default_max_size_mb = 256;
+};
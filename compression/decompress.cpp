@@ -0,0 +1,141 @@
+#include "decompress.hpp"
+#include <zlib.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace {
+    // deflate never expands past about 1032:1, and past this size the doubling loop takes over
+    constexpr size_t max_deflate_ratio = 1032;
+    constexpr size_t max_presized_bytes = 64 * 1024 * 1024;
+}
+
+bool is_gzip_header(const unsigned char* data, size_t size) {
+    return size >= 2 && data[0] == 0x1F && data[1] == 0x8B;
+}
+
+bool is_zlib_header(const unsigned char* data, size_t size) {
+    return size >= 2 && (data[0] & 0x0F) == 8 && (data[0] >> 4) <= 7 && ((data[0] << 8) | data[1]) % 31 == 0;
+}
+
+size_t gzip_uncompressed_size(const unsigned char* data, size_t size) {
+    if (!is_gzip_header(data, size) || size < 18) {
+        return 0;
+    }
+
+    const unsigned char* trailer = data + size - 4;
+    return static_cast<size_t>(trailer[0]) | (static_cast<size_t>(trailer[1]) << 8) |
+        (static_cast<size_t>(trailer[2]) << 16) | (static_cast<size_t>(trailer[3]) << 24);
+}
+
+bool decompress(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+    out.clear();
+    if (!is_compressed(data, size)) {
+        out.assign(data, data + size);
+        return true;
+    }
+
+    // ISIZE is exact for a single member and only a hint otherwise, the loop grows the buffer when it runs out.
+    // it comes from the network, so it is clamped to what the input could inflate to and to a fixed cap
+    size_t expected = std::min(gzip_uncompressed_size(data, size), max_presized_bytes);
+    expected = std::min(expected, size * max_deflate_ratio);
+    // one spare byte lets inflate reach the trailer without a regrow when ISIZE is exact
+    out.resize(std::max<size_t>(expected > 0 ? expected + 1 : size * 4, 4096));
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // 15 + 32 lets zlib pick gzip or zlib framing from the header itself
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        out.clear();
+        return false;
+    }
+
+    size_t consumed = 0;
+    size_t produced = 0;
+    bool ok = true;
+    for (;;) {
+        if (produced == out.size()) {
+            out.resize(out.size() * 2);
+        }
+
+        stream.next_in = const_cast<Bytef*>(data + consumed);
+        stream.avail_in = static_cast<uInt>(std::min<size_t>(size - consumed, UINT_MAX));
+        stream.next_out = out.data() + produced;
+        stream.avail_out = static_cast<uInt>(std::min<size_t>(out.size() - produced, UINT_MAX));
+        uInt avail_in = stream.avail_in;
+        uInt avail_out = stream.avail_out;
+
+        int result = inflate(&stream, Z_NO_FLUSH);
+        consumed += avail_in - stream.avail_in;
+        produced += avail_out - stream.avail_out;
+
+        if (result == Z_STREAM_END) {
+            // concatenated gzip members are valid, anything else after the end is trailing garbage
+            if (is_gzip_header(data + consumed, size - consumed) && inflateReset(&stream) == Z_OK) {
+                continue;
+            }
+            break;
+        }
+        if (result == Z_BUF_ERROR && stream.avail_out > 0) {
+            // input ran out before the end of the stream
+            ok = false;
+            break;
+        }
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            ok = false;
+            break;
+        }
+    }
+
+    inflateEnd(&stream);
+    out.resize(ok ? produced : 0);
+    return ok;
+}
+
+std::vector<unsigned char> c_buffer_pool::acquire(size_t min_capacity) {
+    std::vector<unsigned char> buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // smallest pooled buffer that already fits, otherwise the largest one to grow from
+        auto best = free_.end();
+        for (auto it = free_.begin(); it != free_.end(); ++it) {
+            if (best == free_.end()) {
+                best = it;
+                continue;
+            }
+            bool fits = it->capacity() >= min_capacity;
+            bool best_fits = best->capacity() >= min_capacity;
+            if ((fits && (!best_fits || it->capacity() < best->capacity())) ||
+                (!fits && !best_fits && it->capacity() > best->capacity())) {
+                best = it;
+            }
+        }
+        if (best != free_.end()) {
+            buffer = std::move(*best);
+            free_.erase(best);
+        }
+    }
+
+    buffer.clear();
+    buffer.reserve(min_capacity);
+    return buffer;
+}
+
+void c_buffer_pool::release(std::vector<unsigned char>&& buffer) {
+    if (buffer.capacity() == 0 || buffer.capacity() > max_pooled_bytes) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < max_pooled_buffers) {
+        free_.push_back(std::move(buffer));
+        return;
+    }
+
+    // keep the larger buffers, they are the expensive ones to rebuild
+    auto smallest = std::min_element(free_.begin(), free_.end(),
+        [](const std::vector<unsigned char>& a, const std::vector<unsigned char>& b) { return a.capacity() < b.capacity(); });
+    if (smallest->capacity() < buffer.capacity()) {
+        *smallest = std::move(buffer);
+    }
+}
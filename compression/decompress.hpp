@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// framing checks on the first two bytes of a payload
+bool is_gzip_header(const unsigned char* data, size_t size);
+bool is_zlib_header(const unsigned char* data, size_t size);
+
+inline bool is_compressed(const unsigned char* data, size_t size) {
+    return is_gzip_header(data, size) || is_zlib_header(data, size);
+}
+
+// uncompressed size from the ISIZE trailer of a gzip payload (mod 2^32), 0 when not gzip
+size_t gzip_uncompressed_size(const unsigned char* data, size_t size);
+
+// one-shot gzip/zlib decode into out, replacing its contents but keeping its capacity. output is presized
+// from ISIZE for gzip (clamped, it is only trusted as a hint), concatenated gzip members are decoded back to back. data that is neither gzip nor
+// zlib is copied through unchanged
+bool decompress(const unsigned char* data, size_t size, std::vector<unsigned char>& out);
+
+// recycles large decode buffers so repeated loads reuse the same allocations
+class c_buffer_pool {
+public:
+    static c_buffer_pool& get() {
+        static c_buffer_pool instance;
+        return instance;
+    }
+
+    // empty buffer with at least min_capacity reserved
+    std::vector<unsigned char> acquire(size_t min_capacity);
+    void release(std::vector<unsigned char>&& buffer);
+
+private:
+    c_buffer_pool() = default;
+
+    std::vector<std::vector<unsigned char>> free_;
+    std::mutex mutex_;
+
+    static constexpr size_t max_pooled_buffers = 4;
+    static constexpr size_t max_pooled_bytes = 64 * 1024 * 1024;
+};
+
+// pool-backed buffer that hands its storage back when it goes out of scope
+class c_pooled_buffer {
+public:
+    explicit c_pooled_buffer(size_t min_capacity = 0) : buffer_(c_buffer_pool::get().acquire(min_capacity)) {}
+    ~c_pooled_buffer() { c_buffer_pool::get().release(std::move(buffer_)); }
+
+    c_pooled_buffer(const c_pooled_buffer&) = delete;
+    c_pooled_buffer& operator=(const c_pooled_buffer&) = delete;
+
+    std::vector<unsigned char>& data() { return buffer_; }
+    const std::vector<unsigned char>& data() const { return buffer_; }
+
+private:
+    std::vector<unsigned char> buffer_;
+};
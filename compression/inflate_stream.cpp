@@ -0,0 +1,137 @@
+#include "inflate_stream.hpp"
+#include "decompress.hpp"
+#include <zlib.h>
+#include <algorithm>
+#include <climits>
+
+c_inflate_stream::c_inflate_stream(c_byte_sink sink) : sink_(std::move(sink)) {}
+
+c_inflate_stream::~c_inflate_stream() {
+    if (stream_) {
+        inflateEnd(stream_.get());
+    }
+}
+
+bool c_inflate_stream::begin(const unsigned char* data, size_t size) {
+    if (!is_compressed(header_, header_size_)) {
+        mode_ = e_mode::passthrough;
+        if (!sink_(header_, header_size_)) {
+            mode_ = e_mode::failed;
+            return false;
+        }
+        total_out_ += header_size_;
+        return write(data, size);
+    }
+
+    stream_ = std::make_unique<z_stream_s>();
+    window_ = std::make_unique<unsigned char[]>(window_size);
+
+    // 15 + 32 lets zlib pick gzip or zlib framing from the header itself
+    if (inflateInit2(stream_.get(), 15 + 32) != Z_OK) {
+        stream_.reset();
+        mode_ = e_mode::failed;
+        return false;
+    }
+
+    mode_ = e_mode::inflate;
+    return inflate_chunk(header_, header_size_) && inflate_chunk(data, size);
+}
+
+bool c_inflate_stream::inflate_chunk(const unsigned char* data, size_t size) {
+    while (size > 0) {
+        if (mode_ == e_mode::done) {
+            // concatenated gzip members are valid, anything else after the end is trailing garbage
+            if (is_gzip_header(data, size) && inflateReset(stream_.get()) == Z_OK) {
+                mode_ = e_mode::inflate;
+            }
+            else {
+                return true;
+            }
+        }
+
+        uInt chunk = static_cast<uInt>(std::min<size_t>(size, UINT_MAX));
+        stream_->next_in = const_cast<Bytef*>(data);
+        stream_->avail_in = chunk;
+
+        do {
+            stream_->next_out = window_.get();
+            stream_->avail_out = static_cast<uInt>(window_size);
+
+            int result = inflate(stream_.get(), Z_NO_FLUSH);
+            if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+                mode_ = e_mode::failed;
+                return false;
+            }
+
+            size_t produced = window_size - stream_->avail_out;
+            if (produced > 0) {
+                if (!sink_(window_.get(), produced)) {
+                    mode_ = e_mode::failed;
+                    return false;
+                }
+                total_out_ += produced;
+            }
+
+            if (result == Z_STREAM_END) {
+                mode_ = e_mode::done;
+            }
+            else if (result == Z_BUF_ERROR) {
+                break;
+            }
+        } while (mode_ == e_mode::inflate && (stream_->avail_in > 0 || stream_->avail_out == 0));
+
+        size_t consumed = chunk - stream_->avail_in;
+        data += consumed;
+        size -= consumed;
+        if (consumed == 0 && mode_ == e_mode::inflate) {
+            mode_ = e_mode::failed;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool c_inflate_stream::write(const unsigned char* data, size_t size) {
+    switch (mode_) {
+    case e_mode::detect:
+        while (header_size_ < 2 && size > 0) {
+            header_[header_size_++] = *data++;
+            size--;
+        }
+        if (header_size_ < 2) {
+            return true;
+        }
+        return begin(data, size);
+    case e_mode::passthrough:
+        if (size > 0 && !sink_(data, size)) {
+            mode_ = e_mode::failed;
+            return false;
+        }
+        total_out_ += size;
+        return true;
+    case e_mode::inflate:
+    case e_mode::done:
+        return inflate_chunk(data, size);
+    case e_mode::failed:
+    default:
+        return false;
+    }
+}
+
+bool c_inflate_stream::finish() {
+    switch (mode_) {
+    case e_mode::detect:
+        if (header_size_ > 0 && !sink_(header_, header_size_)) {
+            return false;
+        }
+        total_out_ += header_size_;
+        mode_ = e_mode::passthrough;
+        return true;
+    case e_mode::passthrough:
+    case e_mode::done:
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+struct z_stream_s;
+
+// receives decoded bytes in order, returning false aborts the stream
+using c_byte_sink = std::function<bool(const unsigned char* data, size_t size)>;
+
+// incremental gzip/zlib decoder fed straight from the network. framing is sniffed from the first
+// bytes; payloads that are neither gzip nor zlib are forwarded untouched so plain text can share the pipeline
+class c_inflate_stream {
+public:
+    explicit c_inflate_stream(c_byte_sink sink);
+    ~c_inflate_stream();
+
+    c_inflate_stream(const c_inflate_stream&) = delete;
+    c_inflate_stream& operator=(const c_inflate_stream&) = delete;
+
+    bool write(const unsigned char* data, size_t size);
+    bool finish();
+
+    size_t total_out() const { return total_out_; }
+
+private:
+    enum class e_mode {
+        detect,
+        passthrough,
+        inflate,
+        done,
+        failed
+    };
+
+    bool begin(const unsigned char* data, size_t size);
+    bool inflate_chunk(const unsigned char* data, size_t size);
+
+    c_byte_sink sink_;
+    std::unique_ptr<z_stream_s> stream_;
+    std::unique_ptr<unsigned char[]> window_;
+    unsigned char header_[2] = {0, 0};
+    size_t header_size_ = 0;
+    size_t total_out_ = 0;
+    e_mode mode_ = e_mode::detect;
+
+    static constexpr size_t window_size = 64 * 1024;
+};
@@ -0,0 +1,417 @@
+#include "job_system.hpp"
+#include <algorithm>
+#include <iterator>
+
+// index of the calling thread's worker slot, -1 outside the pool
+static thread_local int worker_index = -1;
+// jobs run inside jobs through wait, only the outermost one counts towards busy time
+static thread_local int run_depth = 0;
+
+static int64_t steady_ticks(std::chrono::steady_clock::time_point time) {
+    return time.time_since_epoch().count();
+}
+
+static int default_thread_count() {
+    const int hw_threads = static_cast<int>(std::thread::hardware_concurrency());
+    return std::max(2, hw_threads - 1);
+}
+
+c_job_system::~c_job_system() {
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    resize(0);
+}
+
+void c_job_system::set_thread_count(int thread_count) {
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    resize(thread_count > 0 ? std::min(thread_count, max_threads) : default_thread_count());
+}
+
+int c_job_system::get_thread_count() const {
+    return thread_count_.load(std::memory_order_acquire);
+}
+
+void c_job_system::start() {
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    if (thread_count_.load(std::memory_order_acquire) == 0) {
+        resize(default_thread_count());
+    }
+}
+
+// config_mutex_ must be held. never called from a job, a worker can't join itself
+void c_job_system::resize(int thread_count) {
+    const int current = thread_count_.load(std::memory_order_acquire);
+    if (thread_count > current) {
+        slot_count_.store(std::max(slot_count_.load(std::memory_order_relaxed), thread_count), std::memory_order_release);
+        thread_count_.store(thread_count, std::memory_order_release);
+        for (int i = current; i < thread_count; i++) {
+            c_worker& worker = workers_[i];
+            worker.started = std::chrono::steady_clock::now();
+            worker.jobs_run.store(0, std::memory_order_relaxed);
+            worker.jobs_stolen.store(0, std::memory_order_relaxed);
+            worker.busy_ns.store(0, std::memory_order_relaxed);
+            worker.thread = std::thread(&c_job_system::worker_thread, this, i);
+        }
+        return;
+    }
+
+    if (thread_count == current) {
+        return;
+    }
+
+    thread_count_.store(thread_count, std::memory_order_seq_cst);
+    {
+        std::lock_guard<std::mutex> sleep_lock(sleep_mutex_);
+    }
+    sleep_cv_.notify_all();
+
+    for (int i = thread_count; i < current; i++) {
+        workers_[i].thread.join();
+    }
+
+    // whatever the retired workers still had queued goes to the shared queue
+    bool moved = false;
+    std::lock_guard<std::mutex> injected_lock(injected_mutex_);
+    for (int i = thread_count; i < current; i++) {
+        std::lock_guard<std::mutex> worker_lock(workers_[i].mutex);
+        for (size_t p = 0; p < priority_count; p++) {
+            auto& jobs = workers_[i].jobs[p];
+            moved = moved || !jobs.empty();
+            std::move(jobs.begin(), jobs.end(), std::back_inserter(injected_[p]));
+            jobs.clear();
+        }
+    }
+
+    if (moved) {
+        sleep_cv_.notify_all();
+    }
+}
+
+c_job_handle c_job_system::submit(std::function<void()> task, e_job_priority priority, const std::vector<c_job_handle>& dependencies) {
+    return submit_job(std::move(task), priority, dependencies, false);
+}
+
+c_job_handle c_job_system::submit_blocking(std::function<void()> task, e_job_priority priority,
+                                           const std::vector<c_job_handle>& dependencies) {
+    return submit_job(std::move(task), priority, dependencies, true);
+}
+
+c_job_handle c_job_system::submit_job(std::function<void()> task, e_job_priority priority, const std::vector<c_job_handle>& dependencies,
+                                      bool blocking) {
+    auto job = std::make_shared<c_job>();
+    job->task_ = std::move(task);
+    job->priority_ = priority;
+    job->blocking_ = blocking;
+
+    // a dependency finishing meanwhile either sees this job in its dependents or was already done
+    for (const auto& dependency : dependencies) {
+        if (!dependency) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(dependency->mutex_);
+        if (!dependency->done_.load(std::memory_order_relaxed)) {
+            job->blockers_.fetch_add(1, std::memory_order_relaxed);
+            dependency->dependents_.push_back(job);
+        }
+    }
+
+    if (thread_count_.load(std::memory_order_acquire) == 0) {
+        start();
+    }
+
+    if (job->blockers_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        enqueue(job);
+    }
+    return job;
+}
+
+c_job_handle c_job_system::submit_after(std::chrono::milliseconds delay, std::function<void()> task, e_job_priority priority) {
+    auto job = std::make_shared<c_job>();
+    job->task_ = std::move(task);
+    job->priority_ = priority;
+
+    if (thread_count_.load(std::memory_order_acquire) == 0) {
+        start();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        delayed_.push({std::chrono::steady_clock::now() + delay, job});
+        next_delayed_.store(steady_ticks(delayed_.top().due), std::memory_order_relaxed);
+    }
+    // sleepers pick up the new deadline
+    sleep_cv_.notify_all();
+    return job;
+}
+
+c_job_handle c_job_system::create_event() {
+    return std::make_shared<c_job>();
+}
+
+void c_job_system::signal(const c_job_handle& event) {
+    if (event && !event->done()) {
+        finish(event);
+    }
+}
+
+void c_job_system::enqueue(c_job_handle job) {
+    const size_t priority = static_cast<size_t>(job->priority_);
+    if (job->blocking_) {
+        {
+            std::lock_guard<std::mutex> lock(injected_mutex_);
+            blocking_[priority].push_back(std::move(job));
+        }
+        blocking_queued_.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_seq_cst) > 0) {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+            }
+            sleep_cv_.notify_one();
+        }
+        return;
+    }
+
+    const int index = worker_index;
+    if (index >= 0) {
+        std::lock_guard<std::mutex> lock(workers_[index].mutex);
+        workers_[index].jobs[priority].push_back(std::move(job));
+    }
+    else {
+        std::lock_guard<std::mutex> lock(injected_mutex_);
+        injected_[priority].push_back(std::move(job));
+    }
+
+    // pairs with the sleeper's sleeping_ increment and queued_ check, one of the two sides sees the other
+    queued_.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_seq_cst) > 0) {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+        }
+        sleep_cv_.notify_one();
+    }
+    if (waiters_.load(std::memory_order_seq_cst) > 0) {
+        {
+            std::lock_guard<std::mutex> lock(done_mutex_);
+        }
+        done_cv_.notify_all();
+    }
+}
+
+// a worker stuck in io must not be the last one free for the jobs everybody else waits on
+bool c_job_system::can_start_blocking() const {
+    const int limit = std::max(1, thread_count_.load(std::memory_order_acquire) - 1);
+    return blocking_queued_.load(std::memory_order_seq_cst) > 0 && blocking_running_.load(std::memory_order_seq_cst) < limit;
+}
+
+// highest priority first: the worker's own deque (newest job), the shared queue, the blocking queue when
+// allowed, then the oldest job of every other worker
+c_job_handle c_job_system::find_job(int index, bool allow_blocking, bool& stolen) {
+    allow_blocking = allow_blocking && can_start_blocking();
+    if (queued_.load(std::memory_order_acquire) == 0 && !allow_blocking) {
+        return nullptr;
+    }
+
+    const int slots = slot_count_.load(std::memory_order_acquire);
+    for (size_t p = priority_count; p-- > 0;) {
+        if (index >= 0) {
+            c_worker& worker = workers_[index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (!worker.jobs[p].empty()) {
+                c_job_handle job = std::move(worker.jobs[p].back());
+                worker.jobs[p].pop_back();
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                return job;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(injected_mutex_);
+            if (!injected_[p].empty()) {
+                c_job_handle job = std::move(injected_[p].front());
+                injected_[p].pop_front();
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                return job;
+            }
+            if (allow_blocking && !blocking_[p].empty() && can_start_blocking()) {
+                c_job_handle job = std::move(blocking_[p].front());
+                blocking_[p].pop_front();
+                blocking_queued_.fetch_sub(1, std::memory_order_relaxed);
+                blocking_running_.fetch_add(1, std::memory_order_relaxed);
+                return job;
+            }
+        }
+
+        for (int k = 1; k <= slots; k++) {
+            const int victim = (index + k) % slots;
+            if (victim == index) {
+                continue;
+            }
+
+            c_worker& worker = workers_[victim];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (!worker.jobs[p].empty()) {
+                c_job_handle job = std::move(worker.jobs[p].front());
+                worker.jobs[p].pop_front();
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                stolen = true;
+                return job;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void c_job_system::run(const c_job_handle& job, int index, bool stolen) {
+    const bool outermost = run_depth++ == 0;
+    const auto started = std::chrono::steady_clock::now();
+
+    job->task_();
+    job->task_ = nullptr;
+    if (job->blocking_) {
+        // a worker may have gone to sleep on the limit, this one could be retiring
+        blocking_running_.fetch_sub(1, std::memory_order_seq_cst);
+        if (blocking_queued_.load(std::memory_order_seq_cst) > 0 && sleeping_.load(std::memory_order_seq_cst) > 0) {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+            }
+            sleep_cv_.notify_one();
+        }
+    }
+
+    run_depth--;
+    if (index >= 0) {
+        c_worker& worker = workers_[index];
+        worker.jobs_run.fetch_add(1, std::memory_order_relaxed);
+        if (stolen) {
+            worker.jobs_stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (outermost) {
+            const auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started);
+            worker.busy_ns.fetch_add(static_cast<uint64_t>(busy.count()), std::memory_order_relaxed);
+        }
+    }
+
+    finish(job);
+}
+
+void c_job_system::finish(const c_job_handle& job) {
+    std::vector<c_job_handle> dependents;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex_);
+        job->done_.store(true, std::memory_order_seq_cst);
+        dependents.swap(job->dependents_);
+    }
+
+    for (auto& dependent : dependents) {
+        if (dependent->blockers_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            enqueue(std::move(dependent));
+        }
+    }
+
+    if (waiters_.load(std::memory_order_seq_cst) > 0) {
+        {
+            std::lock_guard<std::mutex> lock(done_mutex_);
+        }
+        done_cv_.notify_all();
+    }
+}
+
+void c_job_system::promote_delayed() {
+    const auto now = std::chrono::steady_clock::now();
+    if (steady_ticks(now) < next_delayed_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::vector<c_job_handle> due;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        while (!delayed_.empty() && delayed_.top().due <= now) {
+            due.push_back(delayed_.top().job);
+            delayed_.pop();
+        }
+        next_delayed_.store(delayed_.empty() ? INT64_MAX : steady_ticks(delayed_.top().due), std::memory_order_relaxed);
+    }
+
+    for (auto& job : due) {
+        enqueue(std::move(job));
+    }
+}
+
+void c_job_system::worker_thread(int index) {
+    worker_index = index;
+
+    while (index < thread_count_.load(std::memory_order_acquire)) {
+        promote_delayed();
+
+        bool stolen = false;
+        if (c_job_handle job = find_job(index, true, stolen)) {
+            run(job, index, stolen);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleeping_.fetch_add(1, std::memory_order_seq_cst);
+        const bool wake = queued_.load(std::memory_order_seq_cst) > 0 || can_start_blocking() ||
+            index >= thread_count_.load(std::memory_order_acquire) ||
+            (!delayed_.empty() && delayed_.top().due <= std::chrono::steady_clock::now());
+        if (!wake) {
+            if (delayed_.empty()) {
+                sleep_cv_.wait(lock);
+            }
+            else {
+                // copied, delayed_ can grow while the lock is released
+                const auto due = delayed_.top().due;
+                sleep_cv_.wait_until(lock, due);
+            }
+        }
+        sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    worker_index = -1;
+}
+
+void c_job_system::wait(const c_job_handle& job) {
+    if (!job) {
+        return;
+    }
+
+    // blocking jobs are left to the workers' own loops, one of them could hold this thread far past job
+    while (!job->done()) {
+        bool stolen = false;
+        if (c_job_handle other = find_job(worker_index, false, stolen)) {
+            run(other, worker_index, stolen);
+            continue;
+        }
+
+        // woken by any job finishing or being queued, the latter to help with it
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(done_mutex_);
+            if (!job->done_.load(std::memory_order_seq_cst) && queued_.load(std::memory_order_seq_cst) == 0) {
+                done_cv_.wait(lock);
+            }
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+std::vector<c_job_worker_stats> c_job_system::get_worker_stats() const {
+    std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(config_mutex_));
+    const auto now = std::chrono::steady_clock::now();
+    const int thread_count = thread_count_.load(std::memory_order_acquire);
+
+    std::vector<c_job_worker_stats> stats(thread_count);
+    for (int i = 0; i < thread_count; i++) {
+        const c_worker& worker = workers_[i];
+        stats[i].jobs_run = worker.jobs_run.load(std::memory_order_relaxed);
+        stats[i].jobs_stolen = worker.jobs_stolen.load(std::memory_order_relaxed);
+        const auto lifetime = std::chrono::duration_cast<std::chrono::nanoseconds>(now - worker.started).count();
+        if (lifetime > 0) {
+            stats[i].utilization = std::min(1.0, static_cast<double>(worker.busy_ns.load(std::memory_order_relaxed)) / lifetime);
+        }
+    }
+    return stats;
+}
+
+size_t c_job_system::get_queued_jobs() const {
+    return queued_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// every queue is drained high to low. parse chunks and decodes the renderer waits on are high, downloads and
+// ordinary decodes normal, lod chains and texture upgrades low
+enum class e_job_priority {
+    low,
+    normal,
+    high
+};
+
+// one unit of work for c_job_system, queued once every job it depends on has finished
+class c_job {
+public:
+    bool done() const { return done_.load(std::memory_order_acquire); }
+
+private:
+    friend class c_job_system;
+
+    std::function<void()> task_;
+    e_job_priority priority_ = e_job_priority::normal;
+    bool blocking_ = false;
+    std::atomic<int> blockers_{1}; // unfinished dependencies, plus one held by submit while it links them
+    std::atomic<bool> done_{false};
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<c_job>> dependents_;
+};
+
+using c_job_handle = std::shared_ptr<c_job>;
+
+struct c_job_worker_stats {
+    uint64_t jobs_run = 0;
+    uint64_t jobs_stolen = 0; // taken from the front of another worker's deque
+    double utilization = 0.0; // share of the worker's lifetime spent inside jobs
+};
+
+// the one thread pool behind loading, parsing and decoding. every worker owns a deque per priority, pushes and
+// pops its own jobs at the back and steals from the front of the others' when it runs dry. jobs submitted
+// from outside the pool go to a shared queue every worker drains
+class c_job_system {
+public:
+    static c_job_system& get() {
+        static c_job_system instance;
+        return instance;
+    }
+
+    // 0 picks the hardware thread count less one (at least 2). can be changed at any time, a worker that is
+    // let go finishes its current job and hands its queued ones to the rest
+    void set_thread_count(int thread_count);
+    int get_thread_count() const;
+
+    // the pool starts with the default thread count on the first submit
+    c_job_handle submit(std::function<void()> task, e_job_priority priority = e_job_priority::normal,
+                        const std::vector<c_job_handle>& dependencies = {});
+    // for jobs that sleep on io. they are only started by a worker's own loop, never inline by wait or
+    // parallel_for, and one worker is always left for the rest
+    c_job_handle submit_blocking(std::function<void()> task, e_job_priority priority = e_job_priority::normal,
+                                 const std::vector<c_job_handle>& dependencies = {});
+    // queued once delay has passed, a retry backing off doesn't hold a worker
+    c_job_handle submit_after(std::chrono::milliseconds delay, std::function<void()> task,
+                              e_job_priority priority = e_job_priority::normal);
+
+    // a job with nothing to run that finishes when signalled, lets work done outside the pool (a download on
+    // the transfer thread) be a dependency
+    c_job_handle create_event();
+    void signal(const c_job_handle& event);
+
+    // runs queued jobs (blocking ones aside) on the calling thread until job is done, so a job may wait on the
+    // jobs it submitted
+    void wait(const c_job_handle& job);
+
+    // runs task(0..count-1) across the pool, task(0) on the calling thread
+    template <typename t_task>
+    void parallel_for(size_t count, const t_task& task) {
+        std::vector<c_job_handle> jobs;
+        jobs.reserve(count > 0 ? count - 1 : 0);
+        for (size_t i = 1; i < count; i++) {
+            jobs.push_back(submit([&task, i] { task(i); }, e_job_priority::high));
+        }
+        if (count > 0) {
+            task(0);
+        }
+        for (const auto& job : jobs) {
+            wait(job);
+        }
+    }
+
+    // one entry per running worker
+    std::vector<c_job_worker_stats> get_worker_stats() const;
+    size_t get_queued_jobs() const;
+
+private:
+    c_job_system() = default;
+    ~c_job_system();
+
+    static constexpr int max_threads = 64;
+    static constexpr size_t priority_count = 3;
+
+    struct alignas(64) c_worker {
+        std::mutex mutex;
+        std::array<std::deque<c_job_handle>, priority_count> jobs;
+        std::thread thread;
+        std::chrono::steady_clock::time_point started;
+        std::atomic<uint64_t> jobs_run{0};
+        std::atomic<uint64_t> jobs_stolen{0};
+        std::atomic<uint64_t> busy_ns{0};
+    };
+
+    struct c_delayed_job {
+        std::chrono::steady_clock::time_point due;
+        c_job_handle job;
+
+        bool operator<(const c_delayed_job& other) const {
+            return due > other.due; // earliest first
+        }
+    };
+
+    void start();
+    void resize(int thread_count);
+    void worker_thread(int index);
+    c_job_handle submit_job(std::function<void()> task, e_job_priority priority, const std::vector<c_job_handle>& dependencies,
+                            bool blocking);
+    void enqueue(c_job_handle job);
+    bool can_start_blocking() const;
+    c_job_handle find_job(int index, bool allow_blocking, bool& stolen);
+    void run(const c_job_handle& job, int index, bool stolen);
+    void finish(const c_job_handle& job);
+    void promote_delayed();
+
+    std::array<c_worker, max_threads> workers_;
+    std::atomic<int> thread_count_{0}; // workers [0, thread_count_) are running
+    std::atomic<int> slot_count_{0}; // slots that ever ran, stealing looks at all of them
+    std::mutex config_mutex_;
+
+    std::array<std::deque<c_job_handle>, priority_count> injected_;
+    std::array<std::deque<c_job_handle>, priority_count> blocking_; // guarded by injected_mutex_
+    std::mutex injected_mutex_;
+    std::atomic<size_t> queued_{0}; // blocking jobs not included, wait can't help with those
+    std::atomic<size_t> blocking_queued_{0};
+    std::atomic<int> blocking_running_{0}; // only raised under injected_mutex_
+
+    std::priority_queue<c_delayed_job> delayed_; // guarded by sleep_mutex_
+    std::atomic<int64_t> next_delayed_{INT64_MAX}; // steady_clock ticks of delayed_.top()
+
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    std::atomic<int> sleeping_{0};
+
+    std::mutex done_mutex_;
+    std::condition_variable done_cv_;
+    std::atomic<int> waiters_{0};
+};
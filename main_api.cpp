@@ -1,33 +1,92 @@
 #include "main_api.hpp"
-#include <curl.h>
 #include "../../ext/json/json.hpp"
-#include "../../ext/imgui/stb_image.h"
 #include <chrono>
 #include <algorithm>
-#include <thread>
+#include <unordered_set>
+
+// one user's load, shared by the jobs of its pipeline. once the api request is through the model and every
+// texture download are jobs of their own, finish_load depends on all of them
+struct c_avatar_3d_api::c_avatar_3d_load {
+    std::string user_id;
+    c_avatar_3d_data data;
+    int retry_count = 0;
+    bool model_parsed = false;
+    bool model_cached = false; // came from the mesh cache with its materials, nothing left to parse
+    bool mtl_downloaded = false;
+    std::vector<unsigned char> mtl_body;
+    std::atomic<e_avatar_3d_priority> priority{e_avatar_3d_priority::on_screen}; // raised while the load runs
+};
+
+static e_job_priority job_priority(e_avatar_3d_priority priority) {
+    switch (priority) {
+    case e_avatar_3d_priority::local_player:
+        return e_job_priority::high;
+    case e_avatar_3d_priority::background:
+        return e_job_priority::low;
+    default:
+        return e_job_priority::normal;
+    }
+}
+
+// load jobs use all of these, constructing them first keeps them alive until the destructor below has waited
+// for the last load
+c_avatar_3d_api::c_avatar_3d_api() {
+    c_job_system::get();
+    c_texture_cache::get();
+    c_mesh_cache::get();
+    c_texture_disk_cache::get();
+    c_http_client::get();
+}
 
 c_avatar_3d_api::~c_avatar_3d_api() {
-    if (running_.load()) {
-        running_.store(false);
-        queue_cv_.notify_all();
-        if (worker_.joinable()) {
-            worker_.join();
+    running_.store(false);
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    // loads that haven't started are dropped, running and backing off ones notice running_ and end
+    load_queue_ = {};
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (!it->second.in_flight && !it->second.retrying) {
+            it = pending_.erase(it);
+        }
+        else {
+            ++it;
         }
     }
+    idle_cv_.wait(lock, [this] { return pending_.empty(); });
 }
 
-void c_avatar_3d_api::initialize() {
+void c_avatar_3d_api::initialize(const std::string& cache_directory) {
     if (running_.load()) return;
+    c_mesh_cache::get().initialize(cache_directory);
+    c_texture_disk_cache::get().initialize(cache_directory.empty() ? "" : cache_directory + "/textures");
     running_.store(true);
-    worker_ = std::thread(&c_avatar_3d_api::worker_thread, this);
 
     c_texture_cache::get().initialize();
+    c_texture_cache::get().set_max_texture_size(preview_texture_size);
+    c_texture_cache::get().set_texture_compression(e_texture_compression::palette);
+
+}
 
+void c_avatar_3d_api::set_endpoints(const std::string& api_base, const std::string& cdn_base) {
+    std::lock_guard<std::mutex> lock(endpoint_mutex_);
+    api_base_ = api_base.empty() ? default_api_base : api_base;
+    cdn_base_ = cdn_base;
+}
+
+std::string c_avatar_3d_api::get_api_url(const std::string& user_id) {
+    std::lock_guard<std::mutex> lock(endpoint_mutex_);
+    return api_base_ + "/v1/users/avatar-3d?userId=" + user_id;
 }
 
 std::string c_avatar_3d_api::get_cdn_url(const std::string& hash) {
     if (hash.length() < 38) return "";
 
+    {
+        std::lock_guard<std::mutex> lock(endpoint_mutex_);
+        if (!cdn_base_.empty()) {
+            return cdn_base_ + "/" + hash;
+        }
+    }
+
     int i = 31;
     for (int t = 0; t < 38 && t < static_cast<int>(hash.length()); t++) {
         i ^= static_cast<unsigned char>(hash[t]);
@@ -36,42 +95,61 @@ std::string c_avatar_3d_api::get_cdn_url(const std::string& hash) {
     return "https://t" + std::to_string(i % 8) + ".rbxcdn.com/" + hash;
 }
 
-static size_t avatar_3d_curl_write(void* contents, size_t size, size_t nmemb, void* userp) {
-    size_t total = size * nmemb;
-    std::vector<unsigned char>* buffer = static_cast<std::vector<unsigned char>*>(userp);
-    buffer->insert(buffer->end(),
-        static_cast<unsigned char*>(contents),
-        static_cast<unsigned char*>(contents) + total);
-    return total;
-}
-
-std::vector<unsigned char> c_avatar_3d_api::http_get(const std::string& url, bool decompress) {
-    CURL* curl = curl_easy_init();
-    std::vector<unsigned char> buffer;
-
-    if (!curl) {
-        return buffer;
+// one download per hash while any avatar still holds the bytes, failed downloads are not remembered. done runs
+// on the caller's thread for a hit, as a job otherwise
+void c_avatar_3d_api::fetch_texture(const std::string& hash, std::function<void(c_encoded_data)> done) {
+    {
+        std::lock_guard<std::mutex> lock(encoded_mutex_);
+        auto it = encoded_textures_.find(hash);
+        if (it != encoded_textures_.end()) {
+            if (auto data = it->second.lock()) {
+                done(std::move(data));
+                return;
+            }
+            encoded_textures_.erase(it);
+        }
     }
 
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, avatar_3d_curl_write);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 3L);
-
-    if (decompress) {
-        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip, deflate");
-        curl_easy_setopt(curl, CURLOPT_HTTP_CONTENT_DECODING, 1L);
-    }
+    c_http_client::get().get_async(get_cdn_url(hash), [this, hash, done](bool ok, std::vector<unsigned char>&& body) {
+        auto data = std::make_shared<const std::vector<unsigned char>>(std::move(body));
+        if (ok && !data->empty()) {
+            std::lock_guard<std::mutex> lock(encoded_mutex_);
+            for (auto it = encoded_textures_.begin(); it != encoded_textures_.end();) {
+                if (it->second.expired()) {
+                    it = encoded_textures_.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+            encoded_textures_[hash] = data;
+        }
+        done(std::move(data));
+    });
+}
 
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-    }
+void c_avatar_3d_api::http_get_stream(const std::string& url, c_byte_sink sink, std::function<void(bool ok)> done, bool decompress,
+                                      e_job_priority priority) {
+    c_http_client::get().get_stream_async(url, std::move(sink), std::move(done), decompress, priority);
+}
 
-    curl_easy_cleanup(curl);
-    return buffer;
+std::vector<unsigned char> c_avatar_3d_api::http_get(const std::string& url, bool decompress) {
+    return c_http_client::get().get(url, decompress);
+}
+
+// downloads, inflates and hands text to the sink chunk by chunk from jobs, nothing is buffered whole and no
+// thread waits for the download. done runs after the last chunk
+void c_avatar_3d_api::stream_text_file(const std::string& url, std::function<bool(const char*, size_t)> sink,
+                                       std::function<void(bool ok)> done, e_job_priority priority) {
+    auto inflater = std::make_shared<c_inflate_stream>([sink = std::move(sink)](const unsigned char* data, size_t size) {
+        return sink(reinterpret_cast<const char*>(data), size);
+    });
+
+    http_get_stream(url, [inflater](const unsigned char* data, size_t size) {
+        return inflater->write(data, size);
+    }, [inflater, done = std::move(done)](bool downloaded) {
+        done(downloaded && inflater->finish());
+    }, true, priority);
 }
 
 bool c_avatar_3d_api::fetch_model_json(const std::string& url, nlohmann::json& json) {
@@ -80,24 +158,17 @@ bool c_avatar_3d_api::fetch_model_json(const std::string& url, nlohmann::json& j
         return false;
     }
 
-    std::string content(data.begin(), data.end());
-
-    if (content.size() >= 2 &&
-        static_cast<unsigned char>(content[0]) == 0x1F &&
-        static_cast<unsigned char>(content[1]) == 0x8B) {
-        int outlen = 0;
-        char* decompressed = stbi_zlib_decode_malloc(content.data(), static_cast<int>(content.size()), &outlen);
-        if (decompressed && outlen > 0) {
-            content = std::string(decompressed, outlen);
-            free(decompressed);
-        } else {
-            if (decompressed) {
-                free(decompressed);
-            }
+    // http_get already inflates content-encoded bodies, this catches payloads that are gzipped themselves
+    if (is_compressed(data.data(), data.size())) {
+        std::vector<unsigned char> decompressed;
+        if (!decompress(data.data(), data.size(), decompressed)) {
             return false;
         }
+        data.swap(decompressed);
     }
 
+    std::string content(data.begin(), data.end());
+
     if (content.empty() || content[0] != '{') {
         return false;
     }
@@ -111,8 +182,7 @@ bool c_avatar_3d_api::fetch_model_json(const std::string& url, nlohmann::json& j
 }
 
 bool c_avatar_3d_api::fetch_api_data(const std::string& user_id, c_avatar_3d_data& data) {
-    std::string api_url = "https://thumbnails.roblox.com/v1/users/avatar-3d?userId=" + user_id;
-    std::vector<unsigned char> response = http_get(api_url);
+    std::vector<unsigned char> response = http_get(get_api_url(user_id));
     if (response.empty()) {
         return false;
     }
@@ -206,110 +276,291 @@ bool c_avatar_3d_api::fetch_api_data(const std::string& user_id, c_avatar_3d_dat
     }
 }
 
-void c_avatar_3d_api::load_files(c_avatar_3d_data& data) {
-    if (data.mtl_hash.empty() || data.obj_hash.empty()) {
+// both events are signalled in every case, right away for a mesh cache hit
+void c_avatar_3d_api::load_model(const std::shared_ptr<c_avatar_3d_load>& load, const c_job_handle& obj_parsed,
+                                 const c_job_handle& mtl_downloaded) {
+    c_avatar_3d_data& data = load->data;
+    const uint64_t source_key = c_mesh_cache::make_source_key(data.mtl_hash, data.texture_hashes);
+
+    c_mesh_bounds bounds;
+    if (c_mesh_cache::get().load(data.obj_hash, source_key, data.texture_hashes.size(), data.model, &bounds)) {
+        const bool has_aabb = std::any_of(std::begin(data.aabb.min), std::end(data.aabb.min), [](float v) { return v != 0.0f; }) ||
+            std::any_of(std::begin(data.aabb.max), std::end(data.aabb.max), [](float v) { return v != 0.0f; });
+        if (!has_aabb) {
+            std::copy_n(bounds.min, 3, data.aabb.min);
+            std::copy_n(bounds.max, 3, data.aabb.max);
+        }
+        load->model_parsed = true;
+        load->model_cached = true;
+        c_job_system::get().signal(obj_parsed);
+        c_job_system::get().signal(mtl_downloaded);
         return;
     }
 
-    data.mtl_data = http_get(get_cdn_url(data.mtl_hash), true);
-    data.obj_data = http_get(get_cdn_url(data.obj_hash), true);
+    // the mtl downloads while the obj streams in
+    c_http_client::get().get_async(get_cdn_url(data.mtl_hash), [load, mtl_downloaded](bool ok, std::vector<unsigned char>&& body) {
+        load->mtl_downloaded = ok;
+        load->mtl_body = std::move(body);
+        c_job_system::get().signal(mtl_downloaded);
+    }, true);
+
+    // the parser outlives this job, the stream's jobs feed it
+    auto obj_parser = std::make_shared<c_obj_stream_parser>(data.model);
+    stream_text_file(get_cdn_url(data.obj_hash), [obj_parser](const char* text, size_t size) {
+        return obj_parser->write(text, size);
+    }, [load, obj_parser, obj_parsed](bool streamed) {
+        load->model_parsed = obj_parser->finish() && streamed;
+        c_job_system::get().signal(obj_parsed);
+    }, job_priority(load->priority.load()));
+}
 
-    data.texture_data.clear();
-    data.texture_data.reserve(data.texture_hashes.size());
-    for (const auto& hash : data.texture_hashes) {
-        data.texture_data.push_back(http_get(get_cdn_url(hash)));
+// runs once both the obj and the mtl are in, parsing the obj resets the model so the materials go second
+bool c_avatar_3d_api::load_materials(const std::shared_ptr<c_avatar_3d_load>& load) {
+    if (load->model_cached) {
+        return true;
     }
 
-    if (!data.face_texture_hash.empty()) {
-        data.face_texture_data = http_get(get_cdn_url(data.face_texture_hash));
+    c_avatar_3d_data& data = load->data;
+    c_mtl_stream_parser mtl_parser(data.model, data.texture_hashes);
+    c_inflate_stream inflater([&mtl_parser](const unsigned char* text, size_t size) {
+        return mtl_parser.write(reinterpret_cast<const char*>(text), size);
+    });
+    bool mtl_parsed = load->mtl_downloaded && inflater.write(load->mtl_body.data(), load->mtl_body.size()) && inflater.finish();
+    mtl_parsed = mtl_parser.finish() && mtl_parsed;
+    load->mtl_body = {};
+
+    if (mtl_parsed) {
+        const uint64_t source_key = c_mesh_cache::make_source_key(data.mtl_hash, data.texture_hashes);
+        c_mesh_cache::get().store(data.obj_hash, source_key, data.texture_hashes.size(), data.model);
     }
+    return mtl_parsed;
+}
 
-    data.ready = !data.mtl_data.empty() && !data.obj_data.empty();
-    if (data.ready) {
-         data.mtl_data.size(), data.obj_data.size(), data.texture_data.size();
-    } 
-    else {
+// only ever raises the priority. create is false for callers that must not start a second load
+void c_avatar_3d_api::schedule_load(const std::string& user_id, e_avatar_3d_priority priority, bool create) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    auto it = pending_.find(user_id);
+    if (it == pending_.end()) {
+        if (!create || !running_.load()) {
+            return;
+        }
+        it = pending_.emplace(user_id, c_pending_load()).first;
+        it->second.load = std::make_shared<c_avatar_3d_load>();
+        it->second.load->user_id = user_id;
+    }
+    else if (priority <= it->second.priority) {
+        return;
     }
+
+    c_pending_load& pending = it->second;
+    pending.priority = priority;
+    pending.load->priority.store(priority);
+    if (pending.in_flight || pending.retrying) {
+        return;
+    }
+
+    pending.sequence = ++next_sequence_;
+    load_queue_.push({user_id, priority, pending.sequence});
+    dispatch_loads();
 }
 
-void c_avatar_3d_api::process_user(const std::string& user_id) {
-    std::unordered_map<std::string, int> retry_counts;
-    std::unordered_map<std::string, std::chrono::steady_clock::time_point> retry_times;
+// queue_mutex_ must be held
+void c_avatar_3d_api::dispatch_loads() {
+    while (active_loads_ < std::max(1, max_concurrent_loads_) && !load_queue_.empty()) {
+        load_task task = load_queue_.top();
+        load_queue_.pop();
 
-    while (running_.load()) {
-        c_avatar_3d_data data;
+        auto it = pending_.find(task.user_id);
+        if (it == pending_.end() || it->second.sequence != task.sequence || it->second.in_flight || it->second.retrying) {
+            continue;
+        }
 
-        if (!fetch_api_data(user_id, data)) {
-            int retry_count = retry_counts[user_id];
-            auto now = std::chrono::steady_clock::now();
+        it->second.in_flight = true;
+        active_loads_++;
+        std::shared_ptr<c_avatar_3d_load> load = it->second.load;
+        c_job_system::get().submit_blocking([this, load] { fetch_avatar(load); }, job_priority(task.priority));
+    }
+}
 
-            if (retry_count < max_retries) {
-                if (retry_times.find(user_id) == retry_times.end() ||
-                    std::chrono::duration_cast<std::chrono::milliseconds>(now - retry_times[user_id]).count() >= retry_delay_ms) {
-                    retry_counts[user_id]++;
-                    retry_times[user_id] = now;
-                    continue;
-                } else {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    continue;
-                }
-            }
+// the load gives up its slot while it backs off, the next queued one takes it
+void c_avatar_3d_api::retry_load(const std::shared_ptr<c_avatar_3d_load>& load) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        auto it = pending_.find(load->user_id);
+        if (it != pending_.end() && it->second.load == load) {
+            it->second.in_flight = false;
+            it->second.retrying = true;
+            active_loads_--;
+            dispatch_loads();
+        }
+    }
 
-            {
-                std::lock_guard<std::mutex> lock(cache_mutex_);
-                auto it = cache_.find(user_id);
-                if (it != cache_.end()) {
-                    it->second.state = e_avatar_3d_load_state::failed;
-                }
-            }
+    c_job_system::get().submit_after(std::chrono::milliseconds(retry_delay_ms), [this, load] {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        auto it = pending_.find(load->user_id);
+        if (it == pending_.end() || it->second.load != load) {
+            return;
+        }
+        if (!running_.load()) {
+            pending_.erase(it);
+            idle_cv_.notify_all();
             return;
         }
 
-        load_files(data);
+        c_pending_load& pending = it->second;
+        pending.retrying = false;
+        pending.sequence = ++next_sequence_;
+        load_queue_.push({load->user_id, pending.priority, pending.sequence});
+        dispatch_loads();
+    });
+}
+
+void c_avatar_3d_api::fetch_avatar(const std::shared_ptr<c_avatar_3d_load>& load) {
+    if (!running_.load()) {
+        end_load(load->user_id);
+        return;
+    }
+
+    load->data = c_avatar_3d_data();
+    if (!fetch_api_data(load->user_id, load->data)) {
+        // backs off in the job system's timer queue, no worker sleeps through the delay
+        if (load->retry_count++ < max_retries) {
+            retry_load(load);
+            return;
+        }
 
         {
             std::lock_guard<std::mutex> lock(cache_mutex_);
-            auto it = cache_.find(user_id);
+            auto it = cache_.find(load->user_id);
             if (it != cache_.end()) {
-                it->second.data = std::move(data);
-                it->second.state = it->second.data.ready ? e_avatar_3d_load_state::loaded : e_avatar_3d_load_state::failed;
-                it->second.last_update = std::chrono::steady_clock::now();
+                it->second.state = e_avatar_3d_load_state::failed;
             }
         }
-
+        end_load(load->user_id);
         return;
     }
-}
 
-void c_avatar_3d_api::worker_thread() {
-
-    while (running_.load()) {
-        std::string user_id;
+    // the obj is inflated and parsed by jobs as it downloads, while the mtl and the textures download side
+    // by side on the transfer thread. each download signals its own event, the materials are parsed by a job
+    // of their own once the obj and the mtl are in. no worker waits for a download, every stage writes only
+    // its own part of data
+    auto& jobs = c_job_system::get();
+    c_avatar_3d_data& data = load->data;
+    const e_job_priority priority = job_priority(load->priority.load());
+    std::vector<c_job_handle> stages;
+    if (!data.mtl_hash.empty() && !data.obj_hash.empty()) {
+        c_job_handle obj_parsed = jobs.create_event();
+        c_job_handle mtl_downloaded = jobs.create_event();
+        jobs.submit([this, load, obj_parsed, mtl_downloaded] { load_model(load, obj_parsed, mtl_downloaded); }, priority);
+        stages.push_back(jobs.submit([this, load] {
+            load->model_parsed = load->model_parsed && load_materials(load);
+        }, priority, {obj_parsed, mtl_downloaded}));
+
+        data.texture_data.assign(data.texture_hashes.size(), nullptr);
+        for (size_t i = 0; i < data.texture_hashes.size(); i++) {
+            c_job_handle downloaded = jobs.create_event();
+            stages.push_back(downloaded);
+            fetch_texture(data.texture_hashes[i], [load, i, downloaded](c_encoded_data texture) {
+                load->data.texture_data[i] = std::move(texture);
+                c_job_system::get().signal(downloaded);
+            });
+        }
 
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex_);
-            queue_cv_.wait(lock, [this] {
-                return !queue_.empty() || !running_.load();
+        if (!data.face_texture_hash.empty()) {
+            c_job_handle downloaded = jobs.create_event();
+            stages.push_back(downloaded);
+            fetch_texture(data.face_texture_hash, [load, downloaded](c_encoded_data texture) {
+                load->data.face_texture_data = std::move(texture);
+                c_job_system::get().signal(downloaded);
             });
+        }
+    }
 
-            if (!running_.load() && queue_.empty()) {
-                break;
-            }
+    jobs.submit([this, load] { finish_load(load); }, priority, stages);
+}
 
-            if (!queue_.empty()) {
-                user_id = std::move(queue_.front());
-                queue_.pop();
+void c_avatar_3d_api::finish_load(const std::shared_ptr<c_avatar_3d_load>& load) {
+    c_avatar_3d_data& data = load->data;
+    data.ready = load->model_parsed;
+    if (data.ready) {
+        build_lod_chain_async(data.model);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        auto it = cache_.find(load->user_id);
+        if (it != cache_.end()) {
+            // decodes are the last stage, the renderer asking for a texture only raises its priority
+            if (data.ready && running_.load()) {
+                const bool high_priority = load->priority.load() == e_avatar_3d_priority::local_player;
+                std::unordered_set<int> requested_indices;
+                for (const auto& material : data.model.materials) {
+                    const int tex_idx = material.texture_index;
+                    if (tex_idx >= 0 && tex_idx < static_cast<int>(data.texture_data.size()) &&
+                        data.texture_data[tex_idx] && !data.texture_data[tex_idx]->empty() &&
+                        requested_indices.insert(tex_idx).second) {
+                        c_texture_cache::get().request_texture(load->user_id, tex_idx, data.texture_data[tex_idx], high_priority,
+                                                               data.texture_hashes[tex_idx]);
+                    }
+                }
             }
-        }
 
-        if (!user_id.empty()) {
-            process_user(user_id);
+            it->second.data = std::move(data);
+            it->second.state = it->second.data.ready ? e_avatar_3d_load_state::loaded : e_avatar_3d_load_state::failed;
+            it->second.last_update = std::chrono::steady_clock::now();
         }
     }
 
+    end_load(load->user_id);
+}
+
+void c_avatar_3d_api::end_load(const std::string& user_id) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    auto it = pending_.find(user_id);
+    if (it != pending_.end() && it->second.in_flight) {
+        pending_.erase(it);
+        active_loads_--;
+    }
+    dispatch_loads();
+    idle_cv_.notify_all();
+}
+
+void c_avatar_3d_api::set_priority(const std::string& user_id, e_avatar_3d_priority priority) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    auto it = pending_.find(user_id);
+    if (it == pending_.end() || it->second.priority == priority) {
+        return;
+    }
+
+    c_pending_load& pending = it->second;
+    pending.priority = priority;
+    pending.load->priority.store(priority);
+    if (!pending.in_flight && !pending.retrying) {
+        pending.sequence = ++next_sequence_;
+        load_queue_.push({user_id, priority, pending.sequence});
+        dispatch_loads();
+    }
+}
+
+void c_avatar_3d_api::set_max_concurrent_loads(int loads) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    max_concurrent_loads_ = loads > 0 ? loads : default_max_concurrent_loads;
+    dispatch_loads();
+}
+
+int c_avatar_3d_api::get_max_concurrent_loads() const {
+    std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(queue_mutex_));
+    return max_concurrent_loads_;
 }
 
-c_avatar_3d_data* c_avatar_3d_api::request_data(const std::string& user_id) {
+size_t c_avatar_3d_api::get_queued_loads() {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return static_cast<size_t>(std::count_if(pending_.begin(), pending_.end(), [](const auto& pending) {
+        return !pending.second.in_flight;
+    }));
+}
+
+c_avatar_3d_data* c_avatar_3d_api::request_data(const std::string& user_id, e_avatar_3d_priority priority) {
     if (user_id.empty()) return nullptr;
 
     {
@@ -320,6 +571,8 @@ c_avatar_3d_data* c_avatar_3d_api::request_data(const std::string& user_id) {
                 return &it->second.data;
             }
             if (it->second.state == e_avatar_3d_load_state::loading) {
+                // never queues a second load, the first may be finishing right now
+                schedule_load(user_id, priority, false);
                 return nullptr;
             }
         } else {
@@ -330,29 +583,11 @@ c_avatar_3d_data* c_avatar_3d_api::request_data(const std::string& user_id) {
         }
     }
 
-    {
-        std::lock_guard<std::mutex> lock(queue_mutex_);
-        bool already_queued = false;
-        std::queue<std::string> temp = queue_;
-        while (!temp.empty()) {
-            if (temp.front() == user_id) {
-                already_queued = true;
-                break;
-            }
-            temp.pop();
-        }
-
-        if (!already_queued) {
-            queue_.push(user_id);
-        }
-    }
-
-    queue_cv_.notify_one();
-
     if (!running_.load()) {
         initialize();
     }
 
+    schedule_load(user_id, priority, true);
     return nullptr;
 }
 
@@ -384,12 +619,13 @@ bool c_avatar_3d_api::parse_mtl_data(const std::vector<unsigned char>& mtl_data,
     return parse_mtl(mtl_data, model, texture_hashes);
 }
 
-void c_avatar_3d_api::request_texture_decode(const std::string& user_id, int texture_index, const std::vector<unsigned char>& data, bool high_priority) {
-    c_texture_cache::get().request_texture(user_id, texture_index, data, high_priority);
+void c_avatar_3d_api::request_texture_decode(const std::string& user_id, int texture_index, c_encoded_data data, bool high_priority,
+                                             const std::string& content_hash) {
+    c_texture_cache::get().request_texture(user_id, texture_index, std::move(data), high_priority, content_hash);
 }
 
-void c_avatar_3d_api::request_face_texture_decode(const std::string& user_id, const std::vector<unsigned char>& data) {
-    c_texture_cache::get().request_face_texture(user_id, data);
+void c_avatar_3d_api::request_face_texture_decode(const std::string& user_id, c_encoded_data data, const std::string& content_hash) {
+    c_texture_cache::get().request_face_texture(user_id, std::move(data), content_hash);
 }
 
 c_decoded_texture* c_avatar_3d_api::get_decoded_texture(const std::string& user_id, int texture_index) {
@@ -2,16 +2,24 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <mutex>
-#include <thread>
+#include <unordered_set>
 #include <queue>
+#include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <chrono>
-#include <curl.h>
 #include "json/json.hpp"
 #include "parsers/obj_parser.hpp"
 #include "parsers/mtl_parser.hpp"
 #include "texture/texture_cache.hpp"
+#include "texture/texture_sampler.hpp"
+#include "compression/inflate_stream.hpp"
+#include "compression/decompress.hpp"
+#include "cache/mesh_cache.hpp"
+#include "cache/texture_disk_cache.hpp"
+#include "mesh/mesh_lod.hpp"
+#include "jobs/job_system.hpp"
+#include "net/http_client.hpp"
 
 struct c_avatar_3d_data {
     std::string target_id;
@@ -34,10 +42,10 @@ struct c_avatar_3d_data {
     std::vector<std::string> texture_hashes;
     std::string face_texture_hash;
 
-    std::vector<unsigned char> obj_data;
-    std::vector<unsigned char> mtl_data;
-    std::vector<std::vector<unsigned char>> texture_data;
-    std::vector<unsigned char> face_texture_data;
+    // obj/mtl are parsed while they download, only the parsed model is kept
+    c_obj_model model;
+    std::vector<c_encoded_data> texture_data;
+    c_encoded_data face_texture_data;
 
     bool ready = false;
 };
@@ -49,6 +57,14 @@ enum class e_avatar_3d_load_state {
     failed
 };
 
+// which avatars load first. local_player and on_screen are what the overlay is drawing, background is prefetch
+// for players that may come into view
+enum class e_avatar_3d_priority {
+    background,
+    on_screen,
+    local_player
+};
+
 struct c_avatar_3d_cache_entry {
     c_avatar_3d_data data;
     e_avatar_3d_load_state state = e_avatar_3d_load_state::not_loaded;
@@ -62,9 +78,21 @@ public:
         return instance;
     }
 
-    void initialize();
-
-    c_avatar_3d_data* request_data(const std::string& user_id);
+    // loads run as jobs on c_job_system (api request -> model and texture downloads -> decodes), its thread
+    // count is the one knob for all of them
+    void initialize(const std::string& cache_directory = "");
+    // base urls without a trailing slash, for pointing loads at a mirror or a local stand-in server. an empty
+    // api base restores the default, an empty cdn base the usual t0-t7 host pick
+    void set_endpoints(const std::string& api_base, const std::string& cdn_base);
+
+    // a request for a user that is already queued only raises its priority, it never queues a second load
+    c_avatar_3d_data* request_data(const std::string& user_id, e_avatar_3d_priority priority = e_avatar_3d_priority::on_screen);
+    // moves a queued load up or down, e.g. once a player leaves the screen. loads already running keep going
+    void set_priority(const std::string& user_id, e_avatar_3d_priority priority);
+    // loads past the cap wait in the queue, highest priority first
+    void set_max_concurrent_loads(int loads);
+    int get_max_concurrent_loads() const;
+    size_t get_queued_loads();
     e_avatar_3d_load_state get_state(const std::string& user_id);
 
     void clear_cache();
@@ -72,33 +100,86 @@ public:
 
     bool parse_obj_model(const std::vector<unsigned char>& obj_data, c_obj_model& model);
     bool parse_mtl_data(const std::vector<unsigned char>& mtl_data, c_obj_model& model, const std::vector<std::string>& texture_hashes);
-    void request_texture_decode(const std::string& user_id, int texture_index, const std::vector<unsigned char>& data, bool high_priority = false);
-    void request_face_texture_decode(const std::string& user_id, const std::vector<unsigned char>& data);
+    // content_hash lets players wearing the same item share one decoded texture, see c_texture_cache
+    void request_texture_decode(const std::string& user_id, int texture_index, c_encoded_data data, bool high_priority = false,
+                                const std::string& content_hash = "");
+    void request_face_texture_decode(const std::string& user_id, c_encoded_data data, const std::string& content_hash = "");
     c_decoded_texture* get_decoded_texture(const std::string& user_id, int texture_index);
     c_decoded_texture* get_decoded_face_texture(const std::string& user_id);
 
 private:
-    c_avatar_3d_api() = default;
+    struct c_avatar_3d_load;
+
+    c_avatar_3d_api();
     ~c_avatar_3d_api();
 
-    void worker_thread();
-    void process_user(const std::string& user_id);
+    // one per user queued or loading. requests for a user already in here only raise the priority, which
+    // re-queues it under a new sequence
+    struct c_pending_load {
+        std::shared_ptr<c_avatar_3d_load> load;
+        e_avatar_3d_priority priority = e_avatar_3d_priority::on_screen;
+        uint64_t sequence = 0; // the load_queue_ entry that currently stands for this load
+        bool in_flight = false;
+        bool retrying = false; // backing off in the job system's timer queue, not in load_queue_
+    };
+
+    // queue entries are never updated in place, ones whose sequence no longer matches the pending load are skipped
+    struct load_task {
+        std::string user_id;
+        e_avatar_3d_priority priority;
+        uint64_t sequence;
+
+        bool operator<(const load_task& other) const {
+            if (priority != other.priority) {
+                return priority < other.priority; // Priority queue sorts in reverse
+            }
+            return sequence > other.sequence; // first come first served within a priority
+        }
+    };
+
+    void schedule_load(const std::string& user_id, e_avatar_3d_priority priority, bool create);
+    void dispatch_loads();
+    void retry_load(const std::shared_ptr<c_avatar_3d_load>& load);
+    void fetch_avatar(const std::shared_ptr<c_avatar_3d_load>& load);
+    void finish_load(const std::shared_ptr<c_avatar_3d_load>& load);
+    void end_load(const std::string& user_id);
     bool fetch_api_data(const std::string& user_id, c_avatar_3d_data& data);
     bool fetch_model_json(const std::string& url, nlohmann::json& json);
-    void load_files(c_avatar_3d_data& data);
+    void load_model(const std::shared_ptr<c_avatar_3d_load>& load, const c_job_handle& obj_parsed, const c_job_handle& mtl_downloaded);
+    bool load_materials(const std::shared_ptr<c_avatar_3d_load>& load);
     std::vector<unsigned char> http_get(const std::string& url, bool decompress = false);
+    void http_get_stream(const std::string& url, c_byte_sink sink, std::function<void(bool ok)> done, bool decompress,
+                         e_job_priority priority);
+    void stream_text_file(const std::string& url, std::function<bool(const char*, size_t)> sink, std::function<void(bool ok)> done,
+                          e_job_priority priority);
+    std::string get_api_url(const std::string& user_id);
     std::string get_cdn_url(const std::string& hash);
+    void fetch_texture(const std::string& hash, std::function<void(c_encoded_data)> done);
 
     std::unordered_map<std::string, c_avatar_3d_cache_entry> cache_;
     std::mutex cache_mutex_;
 
-    std::queue<std::string> queue_;
+    // encoded textures by cdn hash while any avatar still holds them, so shared items download once
+    std::unordered_map<std::string, std::weak_ptr<const std::vector<unsigned char>>> encoded_textures_;
+    std::mutex encoded_mutex_;
+
+    std::priority_queue<load_task> load_queue_;
+    std::unordered_map<std::string, c_pending_load> pending_; // by user id, guarded by queue_mutex_
+    uint64_t next_sequence_ = 0;
+    int active_loads_ = 0;
+    int max_concurrent_loads_ = default_max_concurrent_loads;
     std::mutex queue_mutex_;
-    std::condition_variable queue_cv_;
+    std::condition_variable idle_cv_;
 
     std::atomic<bool> running_{false};
-    std::thread worker_;
 
+    std::string api_base_ = default_api_base;
+    std::string cdn_base_;
+    std::mutex endpoint_mutex_;
+
+    static constexpr const char* default_api_base = "https://thumbnails.roblox.com";
+    static constexpr int default_max_concurrent_loads = 4; // each load already downloads its files side by side
     static constexpr int max_retries = 30;
     static constexpr int retry_delay_ms = 2000;
+    static constexpr int preview_texture_size = 512; // previews stay under ~300 px, larger textures are downscaled on decode
 };
\ No newline at end of file
@@ -0,0 +1,513 @@
+#include "mesh_lod.hpp"
+#include "../jobs/job_system.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+static constexpr size_t lod_max_levels = 4;
+static constexpr size_t lod_min_faces = 64;
+static constexpr int lod_max_passes = 24;
+static constexpr float lod_max_relative_error = 0.05f;
+static constexpr float lod_min_level_reduction = 0.85f; // a level must drop at least 15% of the faces
+static constexpr double lod_border_weight = 10.0;
+static constexpr double lod_flip_threshold = 0.25;
+
+struct c_lod_position {
+    double x = 0.0, y = 0.0, z = 0.0;
+};
+
+static inline c_lod_position sub(const c_lod_position& a, const c_lod_position& b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+static inline c_lod_position cross(const c_lod_position& a, const c_lod_position& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+static inline double dot(const c_lod_position& a, const c_lod_position& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// sum of weighted squared plane distances, evaluated as a mean over the accumulated weight
+struct c_quadric {
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    void add_plane(const c_lod_position& n, double d, double w) {
+        a00 += w * n.x * n.x;
+        a01 += w * n.x * n.y;
+        a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y;
+        a12 += w * n.y * n.z;
+        a22 += w * n.z * n.z;
+        b0 += w * n.x * d;
+        b1 += w * n.y * d;
+        b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void add(const c_quadric& other) {
+        a00 += other.a00;
+        a01 += other.a01;
+        a02 += other.a02;
+        a11 += other.a11;
+        a12 += other.a12;
+        a22 += other.a22;
+        b0 += other.b0;
+        b1 += other.b1;
+        b2 += other.b2;
+        c += other.c;
+        weight += other.weight;
+    }
+
+    double error(const c_lod_position& p) const {
+        if (weight <= 0.0) {
+            return 0.0;
+        }
+        double e = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+            2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+            2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return std::max(e, 0.0) / weight;
+    }
+};
+
+// free vertices collapse anywhere, border vertices only along their open border, locked vertices
+// (uv seams, material boundaries, non-manifold edges) never move so the level keeps its outline
+enum class e_lod_vertex : unsigned char {
+    free,
+    border,
+    locked
+};
+
+struct c_lod_edge {
+    uint64_t key = 0;
+    unsigned int face = 0;
+};
+
+struct c_lod_builder {
+    std::vector<c_lod_position> positions;
+    std::vector<unsigned int> indices;
+    std::vector<int> face_materials;
+    std::vector<e_lod_vertex> kinds;
+    std::vector<c_quadric> quadrics;
+    double extent = 0.0;
+};
+
+static inline uint64_t edge_key(unsigned int a, unsigned int b) {
+    return (a < b) ? ((static_cast<uint64_t>(a) << 32) | b) : ((static_cast<uint64_t>(b) << 32) | a);
+}
+
+static std::vector<c_lod_edge> collect_edges(const std::vector<unsigned int>& indices) {
+    std::vector<c_lod_edge> edges;
+    edges.reserve(indices.size());
+    for (size_t f = 0; f < indices.size() / 3; f++) {
+        for (int j = 0; j < 3; j++) {
+            edges.push_back({edge_key(indices[f * 3 + j], indices[f * 3 + (j + 1) % 3]), static_cast<unsigned int>(f)});
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const c_lod_edge& a, const c_lod_edge& b) { return a.key < b.key; });
+    return edges;
+}
+
+static void make_source(const c_obj_model& model, c_lod_builder& builder) {
+    const c_obj_render_mesh& render = model.render_mesh;
+    builder.positions.resize(render.vertices.size());
+    for (size_t i = 0; i < render.vertices.size(); i++) {
+        builder.positions[i] = {render.vertices[i].x, render.vertices[i].y, render.vertices[i].z};
+    }
+
+    builder.indices = render.indices;
+    builder.face_materials.assign(builder.indices.size() / 3, -1);
+    for (const auto& submesh : model.mesh.submeshes) {
+        for (unsigned int f = submesh.first_face; f < submesh.first_face + submesh.face_count && f < builder.face_materials.size(); f++) {
+            builder.face_materials[f] = submesh.material_id;
+        }
+    }
+}
+
+static void classify_vertices(c_lod_builder& builder) {
+    const size_t vertex_count = builder.positions.size();
+    builder.kinds.assign(vertex_count, e_lod_vertex::free);
+
+    // welding splits a position per uv, so any position shared by several vertices is a seam
+    std::vector<unsigned int> order(vertex_count);
+    for (size_t i = 0; i < vertex_count; i++) {
+        order[i] = static_cast<unsigned int>(i);
+    }
+    auto position_less = [&](unsigned int a, unsigned int b) {
+        const c_lod_position& pa = builder.positions[a];
+        const c_lod_position& pb = builder.positions[b];
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        return pa.z < pb.z;
+    };
+    std::sort(order.begin(), order.end(), position_less);
+    for (size_t i = 1; i < vertex_count; i++) {
+        if (!position_less(order[i - 1], order[i]) && !position_less(order[i], order[i - 1])) {
+            builder.kinds[order[i - 1]] = e_lod_vertex::locked;
+            builder.kinds[order[i]] = e_lod_vertex::locked;
+        }
+    }
+
+    std::vector<int> vertex_materials(vertex_count, -2);
+    for (size_t f = 0; f < builder.face_materials.size(); f++) {
+        for (int j = 0; j < 3; j++) {
+            unsigned int v = builder.indices[f * 3 + j];
+            if (vertex_materials[v] == -2) {
+                vertex_materials[v] = builder.face_materials[f];
+            }
+            else if (vertex_materials[v] != builder.face_materials[f]) {
+                builder.kinds[v] = e_lod_vertex::locked;
+            }
+        }
+    }
+
+    std::vector<c_lod_edge> edges = collect_edges(builder.indices);
+    for (size_t i = 0; i < edges.size();) {
+        size_t run = i + 1;
+        while (run < edges.size() && edges[run].key == edges[i].key) {
+            run++;
+        }
+
+        unsigned int a = static_cast<unsigned int>(edges[i].key >> 32);
+        unsigned int b = static_cast<unsigned int>(edges[i].key & 0xFFFFFFFFu);
+        if (run - i > 2) {
+            builder.kinds[a] = e_lod_vertex::locked;
+            builder.kinds[b] = e_lod_vertex::locked;
+        }
+        else if (run - i == 1) {
+            for (unsigned int v : {a, b}) {
+                if (builder.kinds[v] == e_lod_vertex::free) {
+                    builder.kinds[v] = e_lod_vertex::border;
+                }
+            }
+        }
+        i = run;
+    }
+}
+
+static void build_quadrics(c_lod_builder& builder) {
+    builder.quadrics.assign(builder.positions.size(), c_quadric());
+
+    for (size_t f = 0; f < builder.indices.size() / 3; f++) {
+        const unsigned int* face = &builder.indices[f * 3];
+        const c_lod_position& p0 = builder.positions[face[0]];
+        c_lod_position n = cross(sub(builder.positions[face[1]], p0), sub(builder.positions[face[2]], p0));
+        double length = std::sqrt(dot(n, n));
+        if (length <= 0.0) {
+            continue;
+        }
+
+        n = {n.x / length, n.y / length, n.z / length};
+        double d = -dot(n, p0);
+        double area = length * 0.5;
+        for (int j = 0; j < 3; j++) {
+            builder.quadrics[face[j]].add_plane(n, d, area);
+        }
+    }
+
+    // open borders get a plane perpendicular to their face so collapses slide along them, not inward
+    std::vector<c_lod_edge> edges = collect_edges(builder.indices);
+    for (size_t i = 0; i < edges.size(); i++) {
+        bool single = (i == 0 || edges[i - 1].key != edges[i].key) &&
+            (i + 1 == edges.size() || edges[i + 1].key != edges[i].key);
+        if (!single) {
+            continue;
+        }
+
+        const unsigned int* face = &builder.indices[edges[i].face * 3];
+        unsigned int a = static_cast<unsigned int>(edges[i].key >> 32);
+        unsigned int b = static_cast<unsigned int>(edges[i].key & 0xFFFFFFFFu);
+        const c_lod_position& p0 = builder.positions[face[0]];
+        c_lod_position n = cross(sub(builder.positions[face[1]], p0), sub(builder.positions[face[2]], p0));
+        c_lod_position edge = sub(builder.positions[b], builder.positions[a]);
+        c_lod_position m = cross(edge, n);
+        double length = std::sqrt(dot(m, m));
+        if (length <= 0.0) {
+            continue;
+        }
+
+        m = {m.x / length, m.y / length, m.z / length};
+        double d = -dot(m, builder.positions[a]);
+        double w = dot(edge, edge) * lod_border_weight;
+        builder.quadrics[a].add_plane(m, d, w);
+        builder.quadrics[b].add_plane(m, d, w);
+    }
+}
+
+static bool collapse_flips(const c_lod_builder& builder, const std::vector<unsigned int>& adjacency,
+    unsigned int first, unsigned int last, unsigned int from, unsigned int to) {
+    for (unsigned int k = first; k < last; k++) {
+        const unsigned int* face = &builder.indices[adjacency[k] * 3];
+        if (face[0] == to || face[1] == to || face[2] == to) {
+            continue;
+        }
+
+        c_lod_position p[3];
+        c_lod_position q[3];
+        for (int j = 0; j < 3; j++) {
+            p[j] = builder.positions[face[j]];
+            q[j] = (face[j] == from) ? builder.positions[to] : p[j];
+        }
+
+        c_lod_position before = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+        c_lod_position after = cross(sub(q[1], q[0]), sub(q[2], q[0]));
+        if (dot(before, after) <= lod_flip_threshold * std::sqrt(dot(before, before) * dot(after, after))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct c_lod_collapse {
+    double cost = 0.0;
+    unsigned int from = 0;
+    unsigned int to = 0;
+};
+
+// one round of independent collapses, cheapest first, until target_faces or max_error is reached
+static bool collapse_pass(c_lod_builder& builder, size_t target_faces, double max_error, double& level_error) {
+    const size_t vertex_count = builder.positions.size();
+    const size_t face_count = builder.indices.size() / 3;
+
+    std::vector<unsigned int> offsets(vertex_count + 1, 0);
+    for (unsigned int v : builder.indices) {
+        offsets[v + 1]++;
+    }
+    for (size_t i = 0; i < vertex_count; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    std::vector<unsigned int> adjacency(builder.indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t f = 0; f < face_count; f++) {
+        for (int j = 0; j < 3; j++) {
+            adjacency[fill[builder.indices[f * 3 + j]]++] = static_cast<unsigned int>(f);
+        }
+    }
+
+    std::vector<c_lod_edge> edges = collect_edges(builder.indices);
+    auto is_border_edge = [&edges](unsigned int a, unsigned int b) {
+        uint64_t key = edge_key(a, b);
+        auto it = std::lower_bound(edges.begin(), edges.end(), key, [](const c_lod_edge& e, uint64_t k) { return e.key < k; });
+        return it != edges.end() && it->key == key && (it + 1 == edges.end() || (it + 1)->key != key);
+    };
+
+    std::vector<c_lod_collapse> collapses;
+    for (unsigned int v = 0; v < vertex_count; v++) {
+        if (builder.kinds[v] == e_lod_vertex::locked || offsets[v] == offsets[v + 1]) {
+            continue;
+        }
+
+        c_lod_collapse best;
+        best.cost = max_error;
+        bool found = false;
+        for (unsigned int k = offsets[v]; k < offsets[v + 1]; k++) {
+            const unsigned int* face = &builder.indices[adjacency[k] * 3];
+            for (int j = 0; j < 3; j++) {
+                unsigned int t = face[j];
+                if (t == v) {
+                    continue;
+                }
+                if (builder.kinds[v] == e_lod_vertex::border &&
+                    (builder.kinds[t] == e_lod_vertex::free || !is_border_edge(v, t))) {
+                    continue;
+                }
+
+                c_quadric combined = builder.quadrics[v];
+                combined.add(builder.quadrics[t]);
+                double cost = combined.error(builder.positions[t]);
+                if (cost <= best.cost) {
+                    best = {cost, v, t};
+                    found = true;
+                }
+            }
+        }
+
+        if (found) {
+            collapses.push_back(best);
+        }
+    }
+
+    std::sort(collapses.begin(), collapses.end(), [](const c_lod_collapse& a, const c_lod_collapse& b) { return a.cost < b.cost; });
+
+    std::vector<unsigned int> remap(vertex_count);
+    for (size_t i = 0; i < vertex_count; i++) {
+        remap[i] = static_cast<unsigned int>(i);
+    }
+
+    // a vertex touched by a collapse keeps its neighbourhood frozen until the next pass
+    std::vector<char> dirty(vertex_count, 0);
+    size_t remaining = face_count;
+    size_t performed = 0;
+    for (const auto& collapse : collapses) {
+        if (remaining <= target_faces) {
+            break;
+        }
+        if (dirty[collapse.from] || dirty[collapse.to]) {
+            continue;
+        }
+        if (collapse_flips(builder, adjacency, offsets[collapse.from], offsets[collapse.from + 1], collapse.from, collapse.to)) {
+            continue;
+        }
+
+        for (unsigned int k = offsets[collapse.from]; k < offsets[collapse.from + 1]; k++) {
+            const unsigned int* face = &builder.indices[adjacency[k] * 3];
+            if (face[0] == collapse.to || face[1] == collapse.to || face[2] == collapse.to) {
+                remaining--;
+            }
+            dirty[face[0]] = dirty[face[1]] = dirty[face[2]] = 1;
+        }
+
+        remap[collapse.from] = collapse.to;
+        builder.quadrics[collapse.to].add(builder.quadrics[collapse.from]);
+        level_error = std::max(level_error, collapse.cost);
+        performed++;
+    }
+
+    if (performed == 0) {
+        return false;
+    }
+
+    size_t write = 0;
+    for (size_t f = 0; f < face_count; f++) {
+        unsigned int a = remap[builder.indices[f * 3]];
+        unsigned int b = remap[builder.indices[f * 3 + 1]];
+        unsigned int c = remap[builder.indices[f * 3 + 2]];
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+        builder.indices[write * 3] = a;
+        builder.indices[write * 3 + 1] = b;
+        builder.indices[write * 3 + 2] = c;
+        builder.face_materials[write] = builder.face_materials[f];
+        write++;
+    }
+    builder.indices.resize(write * 3);
+    builder.face_materials.resize(write);
+    return true;
+}
+
+static c_obj_lod emit_level(const c_lod_builder& builder, double level_error) {
+    c_obj_lod level;
+    level.indices = builder.indices;
+    level.error = builder.extent > 0.0 ? static_cast<float>(std::sqrt(level_error) / builder.extent) : 0.0f;
+
+    const size_t face_count = builder.indices.size() / 3;
+    level.normals.resize(face_count);
+    for (size_t f = 0; f < face_count; f++) {
+        const unsigned int* face = &builder.indices[f * 3];
+        const c_lod_position& p0 = builder.positions[face[0]];
+        c_lod_position n = cross(sub(builder.positions[face[1]], p0), sub(builder.positions[face[2]], p0));
+        double length = std::sqrt(dot(n, n));
+        if (length > 0.0001) {
+            level.normals[f].x = static_cast<float>(n.x / length);
+            level.normals[f].y = static_cast<float>(n.y / length);
+            level.normals[f].z = static_cast<float>(n.z / length);
+        }
+    }
+
+    // collapses never reorder faces, so material runs stay contiguous
+    for (size_t f = 0; f < face_count; f++) {
+        if (level.submeshes.empty() || level.submeshes.back().material_id != builder.face_materials[f]) {
+            c_obj_submesh submesh;
+            submesh.material_id = builder.face_materials[f];
+            submesh.first_face = static_cast<unsigned int>(f);
+            level.submeshes.push_back(submesh);
+        }
+        level.submeshes.back().face_count++;
+    }
+
+    return level;
+}
+
+static void build_levels(c_lod_builder& builder, c_obj_lod_chain& chain) {
+    const size_t full_faces = builder.indices.size() / 3;
+    if (full_faces < lod_min_faces * 2 || builder.positions.empty()) {
+        return;
+    }
+
+    c_lod_position min = builder.positions[0];
+    c_lod_position max = builder.positions[0];
+    for (const auto& p : builder.positions) {
+        min = {std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+        max = {std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+    }
+    builder.extent = std::max(max.x - min.x, std::max(max.y - min.y, max.z - min.z));
+
+    classify_vertices(builder);
+    build_quadrics(builder);
+
+    const double max_error = std::pow(lod_max_relative_error * builder.extent, 2.0);
+    double level_error = 0.0;
+    size_t previous_faces = full_faces;
+    for (size_t level = 1; level <= lod_max_levels; level++) {
+        size_t target_faces = full_faces >> level;
+        if (target_faces < lod_min_faces) {
+            break;
+        }
+
+        for (int pass = 0; pass < lod_max_passes && builder.indices.size() / 3 > target_faces; pass++) {
+            if (!collapse_pass(builder, target_faces, max_error, level_error)) {
+                break;
+            }
+        }
+
+        size_t faces = builder.indices.size() / 3;
+        if (faces > previous_faces * lod_min_level_reduction) {
+            break;
+        }
+
+        chain.levels.push_back(emit_level(builder, level_error));
+        previous_faces = faces;
+    }
+}
+
+void build_lod_chain(c_obj_model& model) {
+    auto chain = std::make_shared<c_obj_lod_chain>();
+    c_lod_builder builder;
+    make_source(model, builder);
+    build_levels(builder, *chain);
+    chain->ready.store(true, std::memory_order_release);
+    model.lods = std::move(chain);
+}
+
+void build_lod_chain_async(c_obj_model& model) {
+    auto chain = std::make_shared<c_obj_lod_chain>();
+    auto builder = std::make_shared<c_lod_builder>();
+    make_source(model, *builder);
+    model.lods = chain;
+
+    c_job_system::get().submit([chain, builder] {
+        build_levels(*builder, *chain);
+        chain->ready.store(true, std::memory_order_release);
+    }, e_job_priority::low);
+}
+
+float projected_lod_size(const float aabb_min[3], const float aabb_max[3], float pixels_per_unit) {
+    float size = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        size = std::max(size, aabb_max[axis] - aabb_min[axis]);
+    }
+    return size * pixels_per_unit;
+}
+
+const c_obj_lod* select_lod(const c_obj_model& model, float projected_size, float max_error_pixels) {
+    const c_obj_lod_chain* chain = model.lods.get();
+    if (!chain || !chain->ready.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    // level errors only grow down the chain, so the first level over budget ends the search
+    const c_obj_lod* selected = nullptr;
+    for (const auto& level : chain->levels) {
+        if (level.error * projected_size > max_error_pixels) {
+            break;
+        }
+        selected = &level;
+    }
+    return selected;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "../parsers/obj_parser.hpp"
+#include <atomic>
+#include <vector>
+
+// one simplified level over the full-detail render_mesh vertex buffer. collapses only ever move a
+// vertex onto an existing neighbour, so levels share the welded vertices and their per-frame transforms
+struct c_obj_lod {
+    std::vector<unsigned int> indices;
+    std::vector<c_obj_normal> normals;
+    std::vector<c_obj_submesh> submeshes;
+
+    // largest collapse error, relative to the longest bounding box side of the model
+    float error = 0.0f;
+
+    size_t face_count() const { return normals.size(); }
+};
+
+// coarser levels follow each other in levels, every one roughly half the faces of the previous.
+// built off the render thread, levels must not be read before ready is set
+struct c_obj_lod_chain {
+    std::vector<c_obj_lod> levels;
+    std::atomic<bool> ready{false};
+};
+
+// builds model.lods synchronously, the model must already have a render mesh
+void build_lod_chain(c_obj_model& model);
+
+// attaches an empty chain to the model and fills it in a low priority job from a copy of the geometry,
+// the model can be drawn (at full detail) and moved around meanwhile
+void build_lod_chain_async(c_obj_model& model);
+
+// on-screen size in pixels of the longest side of an aabb drawn at pixels_per_unit
+float projected_lod_size(const float aabb_min[3], const float aabb_max[3], float pixels_per_unit);
+
+// coarsest level whose error stays under max_error_pixels at the given projected size,
+// nullptr means the full-detail mesh should be drawn
+const c_obj_lod* select_lod(const c_obj_model& model, float projected_size, float max_error_pixels = 0.5f);
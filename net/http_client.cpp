@@ -0,0 +1,420 @@
+#include "http_client.hpp"
+#include <algorithm>
+#include <utility>
+
+static constexpr int poll_timeout_ms = 1000;
+
+// done callbacks run as jobs, constructing the job system first keeps it alive until the destructor below
+c_http_client::c_http_client() {
+    c_job_system::get();
+}
+
+c_http_client::~c_http_client() {
+    if (!running_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    running_.store(false, std::memory_order_release);
+    curl_multi_wakeup(multi_);
+    thread_.join();
+
+    for (auto& transfer : active_) {
+        curl_multi_remove_handle(multi_, transfer->handle);
+        curl_easy_cleanup(transfer->handle);
+        transfer->handle = nullptr;
+        end_transfer(transfer, false);
+    }
+    for (auto& transfer : queued_) {
+        end_transfer(transfer, false);
+    }
+    for (CURL* handle : idle_handles_) {
+        curl_easy_cleanup(handle);
+    }
+
+    curl_multi_cleanup(multi_);
+    curl_share_cleanup(share_);
+}
+
+void c_http_client::set_max_concurrent(int transfers) {
+    max_concurrent_.store(transfers > 0 ? transfers : default_max_concurrent, std::memory_order_relaxed);
+    if (running_.load(std::memory_order_acquire)) {
+        curl_multi_wakeup(multi_);
+    }
+}
+
+int c_http_client::get_max_concurrent() const {
+    return max_concurrent_.load(std::memory_order_relaxed);
+}
+
+size_t c_http_client::get_active_transfers() const {
+    return active_count_.load(std::memory_order_relaxed);
+}
+
+size_t c_http_client::get_queued_transfers() const {
+    std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(mutex_));
+    return queued_.size();
+}
+
+void c_http_client::lock_share(CURL*, curl_lock_data data, curl_lock_access, void* userp) {
+    static_cast<c_http_client*>(userp)->share_mutexes_[data].lock();
+}
+
+void c_http_client::unlock_share(CURL*, curl_lock_data data, void* userp) {
+    static_cast<c_http_client*>(userp)->share_mutexes_[data].unlock();
+}
+
+void c_http_client::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    // connections are already pooled by the multi handle, the share adds dns and tls session reuse
+    share_ = curl_share_init();
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &c_http_client::lock_share);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &c_http_client::unlock_share);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+
+    multi_ = curl_multi_init();
+    curl_multi_setopt(multi_, CURLMOPT_PIPELINING, static_cast<long>(CURLPIPE_MULTIPLEX));
+    curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, max_host_connections);
+    curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, max_idle_connections);
+
+    running_.store(true, std::memory_order_release);
+    thread_ = std::thread(&c_http_client::transfer_thread, this);
+}
+
+void c_http_client::submit(std::shared_ptr<c_transfer> transfer) {
+    if (!running_.load(std::memory_order_acquire)) {
+        start();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_.push_back(std::move(transfer));
+    }
+    curl_multi_wakeup(multi_);
+}
+
+void c_http_client::get_async(const std::string& url, std::function<void(bool ok, std::vector<unsigned char>&& body)> done,
+                              bool decompress) {
+    if (url.empty()) {
+        done(false, {});
+        return;
+    }
+
+    auto transfer = std::make_shared<c_transfer>();
+    transfer->url = url;
+    transfer->decompress = decompress;
+    transfer->done_callback = std::move(done);
+    submit(std::move(transfer));
+}
+
+void c_http_client::get_stream_async(const std::string& url, c_byte_sink sink, std::function<void(bool ok)> done,
+                                     bool decompress, e_job_priority priority) {
+    if (url.empty()) {
+        done(false);
+        return;
+    }
+
+    auto transfer = std::make_shared<c_transfer>();
+    transfer->url = url;
+    transfer->decompress = decompress;
+    transfer->streaming = true;
+    transfer->priority = priority;
+    transfer->sink = std::move(sink);
+    transfer->stream_done = std::move(done);
+    submit(std::move(transfer));
+}
+
+bool c_http_client::get_stream(const std::string& url, const c_byte_sink& sink, bool decompress) {
+    if (url.empty()) {
+        return false;
+    }
+
+    auto transfer = std::make_shared<c_transfer>();
+    transfer->url = url;
+    transfer->decompress = decompress;
+    transfer->streaming = true;
+    submit(transfer);
+
+    // chunks are swapped out under the lock and fed to the sink outside it, the transfer thread keeps
+    // appending meanwhile
+    std::vector<unsigned char> chunk;
+    std::unique_lock<std::mutex> lock(transfer->mutex);
+    for (;;) {
+        transfer->cv.wait(lock, [&transfer] { return !transfer->body.empty() || transfer->done; });
+        if (transfer->body.empty()) {
+            return transfer->ok;
+        }
+
+        chunk.clear();
+        chunk.swap(transfer->body);
+        const bool paused = std::exchange(transfer->paused, false);
+        lock.unlock();
+        if (paused) {
+            resume_transfer(*transfer);
+        }
+        if (!sink(chunk.data(), chunk.size())) {
+            transfer->cancelled.store(true, std::memory_order_release);
+            curl_multi_wakeup(multi_);
+            return false;
+        }
+        lock.lock();
+    }
+}
+
+std::vector<unsigned char> c_http_client::get(const std::string& url, bool decompress) {
+    std::vector<unsigned char> buffer;
+    const bool ok = get_stream(url, [&buffer](const unsigned char* data, size_t size) {
+        buffer.insert(buffer.end(), data, data + size);
+        return true;
+    }, decompress);
+    if (!ok) {
+        buffer.clear(); // error pages aren't bodies
+    }
+    return buffer;
+}
+
+size_t c_http_client::write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    c_transfer* transfer = static_cast<c_transfer*>(userp);
+    if (transfer->cancelled.load(std::memory_order_acquire)) {
+        return 0;
+    }
+
+    const size_t total = size * nmemb;
+    const unsigned char* bytes = static_cast<const unsigned char*>(contents);
+    bool feed = false;
+    {
+        std::lock_guard<std::mutex> lock(transfer->mutex);
+        // curl hands the same bytes over again once the reader has drained body and resumed the transfer
+        if (transfer->streaming && transfer->body.size() >= max_buffered_bytes) {
+            transfer->paused = true;
+            return CURL_WRITEFUNC_PAUSE;
+        }
+        transfer->body.insert(transfer->body.end(), bytes, bytes + total);
+        feed = transfer->sink && !transfer->feeding;
+        transfer->feeding = transfer->feeding || feed;
+    }
+
+    if (feed) {
+        std::shared_ptr<c_transfer> stream = transfer->shared_from_this();
+        c_job_system::get().submit([stream] { c_http_client::get().feed_stream(stream); }, stream->priority);
+    }
+    else if (transfer->streaming) {
+        transfer->cv.notify_one();
+    }
+    return total;
+}
+
+// the job that owns the sink keeps going while chunks arrive and reports done after the last one
+void c_http_client::feed_stream(const std::shared_ptr<c_transfer>& transfer) {
+    std::vector<unsigned char> chunk;
+    for (;;) {
+        bool paused = false;
+        {
+            std::lock_guard<std::mutex> lock(transfer->mutex);
+            if (transfer->body.empty()) {
+                if (!transfer->done) {
+                    transfer->feeding = false;
+                    return;
+                }
+                break;
+            }
+            chunk.clear();
+            chunk.swap(transfer->body);
+            paused = std::exchange(transfer->paused, false);
+        }
+        if (paused) {
+            resume_transfer(*transfer);
+        }
+
+        if (!transfer->cancelled.load(std::memory_order_acquire) && !transfer->sink(chunk.data(), chunk.size())) {
+            transfer->cancelled.store(true, std::memory_order_release);
+            curl_multi_wakeup(multi_);
+        }
+    }
+
+    // feeding stays set, nothing is fed once done has run
+    auto done = std::move(transfer->stream_done);
+    transfer->stream_done = nullptr;
+    done(transfer->ok && !transfer->cancelled.load(std::memory_order_acquire));
+}
+
+// curl_easy_pause is only called by the transfer thread, like everything else touching the handle
+void c_http_client::resume_transfer(c_transfer& transfer) {
+    transfer.resume.store(true, std::memory_order_release);
+    curl_multi_wakeup(multi_);
+}
+
+bool c_http_client::begin_transfer(const std::shared_ptr<c_transfer>& transfer) {
+    CURL* handle = nullptr;
+    if (!idle_handles_.empty()) {
+        handle = idle_handles_.back();
+        idle_handles_.pop_back();
+    }
+    else {
+        handle = curl_easy_init();
+    }
+    if (!handle) {
+        return false;
+    }
+
+    curl_easy_setopt(handle, CURLOPT_URL, transfer->url.c_str());
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &c_http_client::write_callback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, transfer.get());
+    curl_easy_setopt(handle, CURLOPT_SHARE, share_);
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, timeout_seconds);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, connect_timeout_seconds);
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_MAXREDIRS, 3L);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L); // wait for a multiplexed connection over opening another
+
+    if (transfer->decompress) {
+        curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "gzip, deflate");
+        curl_easy_setopt(handle, CURLOPT_HTTP_CONTENT_DECODING, 1L);
+    }
+
+    if (curl_multi_add_handle(multi_, handle) != CURLM_OK) {
+        curl_easy_reset(handle);
+        idle_handles_.push_back(handle);
+        return false;
+    }
+
+    transfer->handle = handle;
+    active_.push_back(transfer);
+    active_count_.store(active_.size(), std::memory_order_relaxed);
+    return true;
+}
+
+void c_http_client::end_transfer(const std::shared_ptr<c_transfer>& transfer, bool ok) {
+    if (transfer->done_callback) {
+        std::vector<unsigned char> body;
+        {
+            std::lock_guard<std::mutex> lock(transfer->mutex);
+            body.swap(transfer->body);
+            transfer->done = true;
+            transfer->ok = ok;
+        }
+        if (!ok) {
+            body.clear();
+        }
+        auto done = std::move(transfer->done_callback);
+        transfer->done_callback = nullptr;
+        // the destructor ends what is left inline, every done still runs before the client is gone
+        if (!running_.load(std::memory_order_acquire)) {
+            done(ok, std::move(body));
+            return;
+        }
+        c_job_system::get().submit([done = std::move(done), ok, body = std::move(body)]() mutable {
+            done(ok, std::move(body));
+        }, transfer->priority);
+        return;
+    }
+
+    if (transfer->sink) {
+        bool feed = false;
+        {
+            std::lock_guard<std::mutex> lock(transfer->mutex);
+            transfer->done = true;
+            transfer->ok = ok;
+            feed = !transfer->feeding;
+            transfer->feeding = true;
+        }
+        if (!feed) {
+            return; // the running feed job reports done
+        }
+        if (!running_.load(std::memory_order_acquire)) {
+            feed_stream(transfer);
+            return;
+        }
+        c_job_system::get().submit([this, transfer] { feed_stream(transfer); }, transfer->priority);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(transfer->mutex);
+        transfer->done = true;
+        transfer->ok = ok;
+    }
+    transfer->cv.notify_all();
+}
+
+void c_http_client::transfer_thread() {
+    std::vector<std::shared_ptr<c_transfer>> finished;
+
+    while (running_.load(std::memory_order_acquire)) {
+        // callbacks run with no lock held, a done callback may submit the next download
+        finished.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const size_t max_concurrent = static_cast<size_t>(std::max(1, max_concurrent_.load(std::memory_order_relaxed)));
+            while (!queued_.empty() && active_.size() < max_concurrent) {
+                std::shared_ptr<c_transfer> transfer = std::move(queued_.front());
+                queued_.pop_front();
+                if (transfer->cancelled.load(std::memory_order_acquire) || !begin_transfer(transfer)) {
+                    finished.push_back(std::move(transfer));
+                }
+            }
+        }
+        for (auto& transfer : finished) {
+            end_transfer(transfer, false);
+        }
+
+        // streams whose reader caught up with a paused transfer, or stopped reading
+        for (auto it = active_.begin(); it != active_.end();) {
+            std::shared_ptr<c_transfer>& transfer = *it;
+            if (!transfer->cancelled.load(std::memory_order_acquire)) {
+                if (transfer->resume.exchange(false, std::memory_order_acq_rel)) {
+                    curl_easy_pause(transfer->handle, CURLPAUSE_CONT);
+                }
+                ++it;
+                continue;
+            }
+            curl_multi_remove_handle(multi_, transfer->handle);
+            curl_easy_reset(transfer->handle);
+            idle_handles_.push_back(transfer->handle);
+            transfer->handle = nullptr;
+            end_transfer(transfer, false);
+            it = active_.erase(it);
+        }
+
+        int still_running = 0;
+        curl_multi_perform(multi_, &still_running);
+
+        int messages_left = 0;
+        while (CURLMsg* message = curl_multi_info_read(multi_, &messages_left)) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            // the message is gone once its handle is removed
+            CURL* handle = message->easy_handle;
+            const CURLcode result = message->data.result;
+            long status = 0;
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+
+            auto it = std::find_if(active_.begin(), active_.end(), [handle](const std::shared_ptr<c_transfer>& transfer) {
+                return transfer->handle == handle;
+            });
+            curl_multi_remove_handle(multi_, handle);
+            curl_easy_reset(handle);
+            idle_handles_.push_back(handle);
+            if (it == active_.end()) {
+                continue;
+            }
+
+            std::shared_ptr<c_transfer> transfer = std::move(*it);
+            active_.erase(it);
+            transfer->handle = nullptr;
+            end_transfer(transfer, result == CURLE_OK && status < 400);
+        }
+        active_count_.store(active_.size(), std::memory_order_relaxed);
+
+        curl_multi_poll(multi_, nullptr, 0, poll_timeout_ms, nullptr);
+    }
+}
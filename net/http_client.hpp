@@ -0,0 +1,104 @@
+#pragma once
+#include "../compression/inflate_stream.hpp"
+#include "../jobs/job_system.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <curl.h>
+
+// every download goes through one curl multi handle on one transfer thread, so connections stay open between
+// requests and an avatar's files come down side by side. dns lookups and tls sessions are shared through a
+// CURLSH, transfers past the concurrency cap wait their turn
+class c_http_client {
+public:
+    static c_http_client& get() {
+        static c_http_client instance;
+        return instance;
+    }
+
+    // transfers running at once across all hosts, the rest queue in submission order
+    void set_max_concurrent(int transfers);
+    int get_max_concurrent() const;
+
+    // the whole body, done runs as a c_job_system job so the transfer thread never waits on it. decompress asks
+    // for gzip/deflate content encoding, curl inflates it
+    void get_async(const std::string& url, std::function<void(bool ok, std::vector<unsigned char>&& body)> done,
+                   bool decompress = false);
+
+    // sink runs in jobs as chunks arrive, in order and one at a time, so parsing overlaps the download without
+    // a thread waiting for it. done runs as a job after the last chunk. the transfer pauses while
+    // max_buffered_bytes wait for the sink, a sink returning false aborts it
+    void get_stream_async(const std::string& url, c_byte_sink sink, std::function<void(bool ok)> done,
+                          bool decompress = false, e_job_priority priority = e_job_priority::normal);
+
+    // blocks until the download ends, sink runs on the calling thread as chunks arrive. for threads outside the
+    // job system and jobs submitted with submit_blocking
+    bool get_stream(const std::string& url, const c_byte_sink& sink, bool decompress = false);
+    std::vector<unsigned char> get(const std::string& url, bool decompress = false);
+
+    size_t get_active_transfers() const;
+    size_t get_queued_transfers() const;
+
+private:
+    // one download as the transfer thread and the caller see it
+    struct c_transfer : std::enable_shared_from_this<c_transfer> {
+        std::string url;
+        bool decompress = false;
+        bool streaming = false; // handed on as it arrives instead of being collected
+        e_job_priority priority = e_job_priority::normal;
+        std::function<void(bool ok, std::vector<unsigned char>&& body)> done_callback;
+        c_byte_sink sink; // fed by jobs, set for get_stream_async only
+        std::function<void(bool ok)> stream_done;
+        CURL* handle = nullptr; // only touched by the transfer thread
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> resume{false}; // the reader caught up, the transfer thread unpauses it
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<unsigned char> body; // the whole body, or what the streaming reader hasn't taken yet
+        bool done = false;
+        bool ok = false;
+        bool paused = false; // the write callback refused data until body is drained
+        bool feeding = false; // a job owns the sink, another one is only submitted once it returns
+    };
+
+    c_http_client();
+    ~c_http_client();
+
+    void submit(std::shared_ptr<c_transfer> transfer);
+    void start();
+    void transfer_thread();
+    bool begin_transfer(const std::shared_ptr<c_transfer>& transfer);
+    void end_transfer(const std::shared_ptr<c_transfer>& transfer, bool ok);
+    void feed_stream(const std::shared_ptr<c_transfer>& transfer);
+    void resume_transfer(c_transfer& transfer);
+    static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp);
+    static void lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* userp);
+    static void unlock_share(CURL* handle, curl_lock_data data, void* userp);
+
+    CURLM* multi_ = nullptr;
+    CURLSH* share_ = nullptr;
+    std::mutex share_mutexes_[CURL_LOCK_DATA_LAST];
+    std::vector<CURL*> idle_handles_; // reset and reused, only touched by the transfer thread
+
+    std::deque<std::shared_ptr<c_transfer>> queued_; // guarded by mutex_
+    std::vector<std::shared_ptr<c_transfer>> active_; // only touched by the transfer thread
+    std::atomic<size_t> active_count_{0};
+    std::mutex mutex_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<int> max_concurrent_{default_max_concurrent};
+
+    static constexpr int default_max_concurrent = 16;
+    static constexpr long max_host_connections = 8;
+    static constexpr long max_idle_connections = 32;
+    static constexpr long timeout_seconds = 10;
+    static constexpr long connect_timeout_seconds = 5;
+    static constexpr size_t max_buffered_bytes = 1024 * 1024; // per stream, past it the transfer is paused
+};
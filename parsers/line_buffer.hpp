@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// regroups text arriving in arbitrary pieces into runs of whole lines. complete lines are handed
+// out in place, only a line straddling two writes is copied. text after a nul byte is ignored
+class c_line_buffer {
+public:
+    template <typename t_handler>
+    void write(std::string_view input, t_handler&& handler) {
+        if (terminated_ || input.empty()) {
+            return;
+        }
+
+        size_t terminator = input.find('\0');
+        if (terminator != std::string_view::npos) {
+            input = input.substr(0, terminator);
+            terminated_ = true;
+        }
+
+        size_t last_newline = input.rfind('\n');
+        if (last_newline == std::string_view::npos) {
+            carry_.append(input.data(), input.size());
+            return;
+        }
+
+        size_t consumed = 0;
+        if (!carry_.empty()) {
+            consumed = input.find('\n') + 1;
+            carry_.append(input.data(), consumed);
+            handler(std::string_view(carry_));
+            carry_.clear();
+        }
+
+        if (last_newline + 1 > consumed) {
+            handler(input.substr(consumed, last_newline + 1 - consumed));
+        }
+
+        carry_.assign(input.data() + last_newline + 1, input.size() - last_newline - 1);
+    }
+
+    template <typename t_handler>
+    void flush(t_handler&& handler) {
+        if (!carry_.empty()) {
+            handler(std::string_view(carry_));
+            carry_.clear();
+        }
+    }
+
+private:
+    std::string carry_;
+    bool terminated_ = false;
+};
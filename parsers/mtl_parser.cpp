@@ -1,55 +1,21 @@
 #include "mtl_parser.hpp"
-#include "../../ext/imgui/stb_image.h"
+#include "number_parser.hpp"
+#include "line_buffer.hpp"
+#include "../compression/decompress.hpp"
 #include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <unordered_map>
 
 
-static std::vector<unsigned char> decompress_data(const std::vector<unsigned char>& data) {
-    if (data.size() < 2 || data[0] != 0x1F || data[1] != 0x8B) {
-        return data;
-    }
-
-    int outlen = 0;
-    char* decompressed = stbi_zlib_decode_malloc(
-        reinterpret_cast<const char*>(data.data()),
-        static_cast<int>(data.size()),
-        &outlen
-    );
-
-    if (!decompressed || outlen <= 0) {
-        if (decompressed) {
-            free(decompressed);
-        }
-        return {};
-    }
-
-    std::vector<unsigned char> result(
-        reinterpret_cast<unsigned char*>(decompressed),
-        reinterpret_cast<unsigned char*>(decompressed) + outlen
-    );
-    free(decompressed);
-
-    return result;
-}
-
-static std::string clean_string(const std::vector<unsigned char>& data) {
-    std::string result;
-    result.reserve(data.size());
-
-    for (unsigned char c : data) {
-        if (c == '\0') break;
-        if (c >= 32 || c == '\n' || c == '\r' || c == '\t') {
-            result += static_cast<char>(c);
-        }
-    }
-
-    return result;
+static inline bool is_blank(char c) {
+    return static_cast<unsigned char>(c) <= ' ';
 }
 
-static inline void trim_whitespace(std::string& str) {
-    str.erase(0, str.find_first_not_of(" \t\r\n"));
-    str.erase(str.find_last_not_of(" \t\r\n") + 1);
+static inline std::string_view trim_view(std::string_view str) {
+    while (!str.empty() && is_blank(str.front())) str.remove_prefix(1);
+    while (!str.empty() && is_blank(str.back())) str.remove_suffix(1);
+    return str;
 }
 
 static std::string extract_hash_from_path(const std::string& path) {
@@ -68,9 +34,36 @@ static std::string extract_hash_from_path(const std::string& path) {
     return filename;
 }
 
-static int find_texture_index(const std::string& texture_path, const std::vector<std::string>& texture_hashes) {
+// texture hash -> index into the api's texture list, first occurrence wins
+using c_texture_index_map = std::unordered_map<std::string, int>;
+
+static c_texture_index_map index_texture_hashes(const std::vector<std::string>& texture_hashes) {
+    c_texture_index_map indices;
+    indices.reserve(texture_hashes.size());
+    for (size_t i = 0; i < texture_hashes.size(); i++) {
+        indices.emplace(texture_hashes[i], static_cast<int>(i));
+    }
+    return indices;
+}
+
+static int find_texture_index(const std::string& texture_path, const std::vector<std::string>& texture_hashes,
+    const c_texture_index_map& texture_indices) {
     std::string extracted_hash = extract_hash_from_path(texture_path);
 
+    auto it = texture_indices.find(extracted_hash);
+    if (it != texture_indices.end()) {
+        return it->second;
+    }
+
+    size_t extension = extracted_hash.find('.');
+    if (extension != std::string::npos) {
+        it = texture_indices.find(extracted_hash.substr(0, extension));
+        if (it != texture_indices.end()) {
+            return it->second;
+        }
+    }
+
+    // paths that do not carry the bare cdn hash fall back to the old substring match
     for (size_t i = 0; i < texture_hashes.size(); i++) {
         const std::string& hash = texture_hashes[i];
         if (hash.find(extracted_hash) != std::string::npos ||
@@ -87,96 +80,144 @@ static float clamp_float(float val) {
     return std::max(0.0f, std::min(1.0f, val));
 }
 
-bool parse_mtl(const std::vector<unsigned char>& mtl_data, c_obj_model& model, const std::vector<std::string>& texture_hashes) {
-    if (mtl_data.empty()) {
-        return false;
+static void parse_color(std::string_view data, float (&color)[3]) {
+    const char* cur = data.data();
+    const char* end = cur + data.size();
+    for (float& channel : color) {
+        float value = 0.0f;
+        parse_float(cur, end, value);
+        channel = clamp_float(value);
     }
+}
 
-    std::vector<unsigned char> decompressed = decompress_data(mtl_data);
-    if (decompressed.empty()) {
-        return false;
+struct c_mtl_parse_state {
+    c_obj_model* model = nullptr;
+    const std::vector<std::string>* texture_hashes = nullptr;
+    c_texture_index_map texture_indices;
+    int current_material = -1;
+    int texture_counter = 0;
+    size_t material_count = 0;
+};
+
+static void parse_mtl_line(std::string_view line, c_mtl_parse_state& state) {
+    line = trim_view(line);
+    if (line.empty() || line[0] == '#') {
+        return;
     }
 
-    std::string content = clean_string(decompressed);
-    if (content.size() < 5) {
-        return false;
+    if (line.length() < 3) return;
+
+    size_t space_pos = 0;
+    while (space_pos < line.size() && !is_blank(line[space_pos])) space_pos++;
+    if (space_pos == line.size()) return;
+
+    std::string_view type = line.substr(0, space_pos);
+    std::string_view data = trim_view(line.substr(space_pos + 1));
+
+    if (type == "newmtl") {
+        state.current_material = data.empty() ? -1 : state.model->intern_material(std::string(data));
+        if (state.current_material >= 0) {
+            c_obj_material& mat = state.model->materials[state.current_material];
+            mat = c_obj_material();
+            mat.defined = true;
+            state.material_count++;
+        }
+        return;
     }
 
-    std::string current_material;
-    int texture_counter = 0;
-    size_t material_count = 0;
+    if (state.current_material < 0) {
+        return;
+    }
 
-    size_t line_start = 0;
-    size_t content_len = content.length();
+    c_obj_material& mat = state.model->materials[state.current_material];
+
+    if (type == "Kd") {
+        parse_color(data, mat.diffuse);
+    }
+    else if (type == "Ka") {
+        parse_color(data, mat.ambient);
+    }
+    else if (type == "Ks") {
+        parse_color(data, mat.specular);
+    }
+    else if (type == "Ns") {
+        const char* cur = data.data();
+        float shininess = 0.0f;
+        parse_float(cur, cur + data.size(), shininess);
+        mat.shininess = std::max(0.0f, shininess);
+    }
+    else if (type == "map_Kd") {
+        mat.diffuse_texture.assign(data.data(), data.size());
+        int tex_idx = find_texture_index(mat.diffuse_texture, *state.texture_hashes, state.texture_indices);
+        mat.texture_index = (tex_idx >= 0) ? tex_idx : state.texture_counter++;
+    }
+}
 
-    while (line_start < content_len) {
-        size_t line_end = content.find('\n', line_start);
-        if (line_end == std::string::npos) {
-            line_end = content_len;
+static void parse_mtl_lines(std::string_view text, c_mtl_parse_state& state) {
+    size_t line_start = 0;
+    while (line_start < text.size()) {
+        size_t line_end = text.find('\n', line_start);
+        if (line_end == std::string_view::npos) {
+            line_end = text.size();
         }
 
-        std::string line = content.substr(line_start, line_end - line_start);
+        parse_mtl_line(text.substr(line_start, line_end - line_start), state);
         line_start = line_end + 1;
+    }
+}
 
-        trim_whitespace(line);
-        if (line.empty() || line[0] == '#') {
-            continue;
+bool parse_mtl(const std::vector<unsigned char>& mtl_data, c_obj_model& model, const std::vector<std::string>& texture_hashes) {
+    if (mtl_data.empty()) {
+        return false;
+    }
+
+    std::string_view content(reinterpret_cast<const char*>(mtl_data.data()), mtl_data.size());
+    c_pooled_buffer decompressed;
+    if (is_compressed(mtl_data.data(), mtl_data.size())) {
+        if (!decompress(mtl_data.data(), mtl_data.size(), decompressed.data()) || decompressed.data().empty()) {
+            return false;
         }
+        content = std::string_view(reinterpret_cast<const char*>(decompressed.data().data()), decompressed.data().size());
+    }
 
-        if (line.length() < 3) continue;
+    content = content.substr(0, content.find('\0'));
+    if (content.size() < 5) {
+        return false;
+    }
 
-        size_t space_pos = line.find(' ');
-        if (space_pos == std::string::npos) space_pos = line.find('\t');
-        if (space_pos == std::string::npos) continue;
+    c_mtl_parse_state state;
+    state.model = &model;
+    state.texture_hashes = &texture_hashes;
+    state.texture_indices = index_texture_hashes(texture_hashes);
+    parse_mtl_lines(content, state);
 
-        std::string type = line.substr(0, space_pos);
-        std::string data = line.substr(space_pos + 1);
-        trim_whitespace(data);
+    return state.material_count > 0;
+}
 
-        if (type == "newmtl") {
-            current_material = data;
-            if (!current_material.empty()) {
-                model.materials[current_material] = c_obj_material();
-                material_count++;
-            }
-        }
-        else if (!current_material.empty() && model.materials.find(current_material) != model.materials.end()) {
-            c_obj_material& mat = model.materials[current_material];
-
-            if (type == "Kd") {
-                const char* str = data.c_str();
-                char* end;
-                mat.diffuse[0] = clamp_float(std::strtof(str, &end));
-                mat.diffuse[1] = clamp_float(std::strtof(end, &end));
-                mat.diffuse[2] = clamp_float(std::strtof(end, &end));
-            }
-            else if (type == "Ka") {
-                const char* str = data.c_str();
-                char* end;
-                mat.ambient[0] = clamp_float(std::strtof(str, &end));
-                mat.ambient[1] = clamp_float(std::strtof(end, &end));
-                mat.ambient[2] = clamp_float(std::strtof(end, &end));
-            }
-            else if (type == "Ks") {
-                const char* str = data.c_str();
-                char* end;
-                mat.specular[0] = clamp_float(std::strtof(str, &end));
-                mat.specular[1] = clamp_float(std::strtof(end, &end));
-                mat.specular[2] = clamp_float(std::strtof(end, &end));
-            }
-            else if (type == "Ns") {
-                const char* str = data.c_str();
-                char* end;
-                float shininess = std::strtof(str, &end);
-                mat.shininess = std::max(0.0f, shininess);
-            }
-            else if (type == "map_Kd") {
-                mat.diffuse_texture = data;
-                int tex_idx = find_texture_index(data, texture_hashes);
-                mat.texture_index = (tex_idx >= 0) ? tex_idx : texture_counter++;
-            }
-        }
-    }
+struct c_mtl_stream_state {
+    c_mtl_parse_state parse;
+    c_line_buffer lines;
+};
+
+c_mtl_stream_parser::c_mtl_stream_parser(c_obj_model& model, const std::vector<std::string>& texture_hashes)
+    : texture_hashes_(texture_hashes), state_(std::make_unique<c_mtl_stream_state>()) {
+    state_->parse.model = &model;
+    state_->parse.texture_hashes = &texture_hashes_;
+    state_->parse.texture_indices = index_texture_hashes(texture_hashes_);
+}
 
-    return material_count > 0;
-}
\ No newline at end of file
+c_mtl_stream_parser::~c_mtl_stream_parser() = default;
+
+bool c_mtl_stream_parser::write(const char* data, size_t size) {
+    state_->lines.write(std::string_view(data, size), [this](std::string_view text) {
+        parse_mtl_lines(text, state_->parse);
+    });
+    return true;
+}
+
+bool c_mtl_stream_parser::finish() {
+    state_->lines.flush([this](std::string_view text) {
+        parse_mtl_lines(text, state_->parse);
+    });
+    return state_->parse.material_count > 0;
+}
@@ -2,5 +2,22 @@
 #include "obj_parser.hpp"
 #include <vector>
 #include <string>
+#include <memory>
 
-bool parse_mtl(const std::vector<unsigned char>& mtl_data, c_obj_model& model, const std::vector<std::string>& texture_hashes);
\ No newline at end of file
+bool parse_mtl(const std::vector<unsigned char>& mtl_data, c_obj_model& model, const std::vector<std::string>& texture_hashes);
+
+struct c_mtl_stream_state;
+
+// incremental counterpart of parse_mtl, fed with decompressed text as it downloads
+class c_mtl_stream_parser {
+public:
+    c_mtl_stream_parser(c_obj_model& model, const std::vector<std::string>& texture_hashes);
+    ~c_mtl_stream_parser();
+
+    bool write(const char* data, size_t size);
+    bool finish();
+
+private:
+    std::vector<std::string> texture_hashes_;
+    std::unique_ptr<c_mtl_stream_state> state_;
+};
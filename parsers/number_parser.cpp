@@ -0,0 +1,261 @@
+#include "number_parser.hpp"
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NUMBER_PARSER_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static inline bool is_blank(char c) {
+    return static_cast<unsigned char>(c) <= ' ';
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline unsigned int first_set_bit(unsigned int mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned int>(index);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+size_t count_digits(const char* cur, const char* end) {
+    const char* start = cur;
+
+#ifdef NUMBER_PARSER_SSE2
+    const __m128i below = _mm_set1_epi8('0' - 1);
+    const __m128i above = _mm_set1_epi8('9' + 1);
+    while (end - cur >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur));
+        __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(chunk, below), _mm_cmplt_epi8(chunk, above));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(digits)) ^ 0xFFFFu;
+        if (mask != 0) {
+            return static_cast<size_t>(cur - start) + first_set_bit(mask);
+        }
+        cur += 16;
+    }
+#endif
+
+    while (cur < end && is_digit(*cur)) cur++;
+    return static_cast<size_t>(cur - start);
+}
+
+// converts eight ascii digits at once, little endian swar
+static inline uint64_t parse_eight_digits(const char* p) {
+    uint64_t val;
+    std::memcpy(&val, p, sizeof(val));
+    val = (val & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+    val = (val & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
+    return (val & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32;
+}
+
+static inline uint64_t accumulate_digits(uint64_t value, const char* p, size_t count) {
+    while (count >= 8) {
+        value = value * 100000000ULL + parse_eight_digits(p);
+        p += 8;
+        count -= 8;
+    }
+    while (count > 0) {
+        value = value * 10 + static_cast<uint64_t>(*p - '0');
+        p++;
+        count--;
+    }
+    return value;
+}
+
+// every power of ten up to 1e10 is exact in a float, so one multiply or divide
+// of an exact mantissa rounds exactly like strtof does
+static constexpr float exact_powers_of_ten[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+static constexpr uint64_t max_exact_mantissa = 1ULL << 24;
+static constexpr size_t max_mantissa_digits = 19;
+
+static bool parse_float_fast(const char* begin, const char* end, const char*& parsed_end, float& out) {
+    const char* p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        return false;
+    }
+
+    size_t int_digits = count_digits(p, end);
+    const char* int_begin = p;
+    p += int_digits;
+
+    size_t frac_digits = 0;
+    const char* frac_begin = p;
+    if (p < end && *p == '.') {
+        frac_begin = p + 1;
+        frac_digits = count_digits(frac_begin, end);
+        p = frac_begin + frac_digits;
+    }
+
+    if (int_digits == 0 && frac_digits == 0) {
+        return false;
+    }
+
+    while (int_digits > 0 && *int_begin == '0') {
+        int_begin++;
+        int_digits--;
+    }
+    if (int_digits + frac_digits > max_mantissa_digits) {
+        return false;
+    }
+
+    uint64_t mantissa = accumulate_digits(0, int_begin, int_digits);
+    mantissa = accumulate_digits(mantissa, frac_begin, frac_digits);
+
+    int exponent = 0;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool exp_negative = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            exp_negative = (*e == '-');
+            e++;
+        }
+
+        size_t exp_digits = count_digits(e, end);
+        if (exp_digits > 0) {
+            if (exp_digits > 4) {
+                return false;
+            }
+            exponent = static_cast<int>(accumulate_digits(0, e, exp_digits));
+            if (exp_negative) exponent = -exponent;
+            p = e + exp_digits;
+        }
+    }
+
+    exponent -= static_cast<int>(frac_digits);
+
+    float value;
+    if (mantissa == 0) {
+        value = 0.0f;
+    }
+    else if (mantissa <= max_exact_mantissa && exponent >= -10 && exponent <= 10) {
+        value = static_cast<float>(mantissa);
+        value = (exponent < 0) ? (value / exact_powers_of_ten[-exponent]) : (value * exact_powers_of_ten[exponent]);
+    }
+    else {
+        return false;
+    }
+
+    out = negative ? -value : value;
+    parsed_end = p;
+    return true;
+}
+
+static bool parse_float_strtof(const char* begin, const char* end, const char*& parsed_end, float& out) {
+    char buffer[64];
+    size_t len = 0;
+    while (begin + len < end && len < sizeof(buffer) - 1 && !is_blank(begin[len])) {
+        buffer[len] = begin[len];
+        len++;
+    }
+    buffer[len] = '\0';
+
+    char* buffer_end;
+    out = std::strtof(buffer, &buffer_end);
+    if (buffer_end == buffer) {
+        return false;
+    }
+
+    parsed_end = begin + (buffer_end - buffer);
+    return true;
+}
+
+static bool parse_float_slow(const char* begin, const char* end, const char*& parsed_end, float& out) {
+    const char* p = begin;
+    if (p < end && *p == '+') {
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) {
+            return false;
+        }
+    }
+
+    const char* digits = (p < end && *p == '-') ? p + 1 : p;
+    if (end - digits >= 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+        return parse_float_strtof(begin, end, parsed_end, out);
+    }
+
+    float value = 0.0f;
+    std::from_chars_result result = std::from_chars(p, end, value, std::chars_format::general);
+    if (result.ec == std::errc::result_out_of_range) {
+        return parse_float_strtof(begin, end, parsed_end, out);
+    }
+    if (result.ec != std::errc()) {
+        return false;
+    }
+
+    out = value;
+    parsed_end = result.ptr;
+    return true;
+}
+
+bool parse_float(const char*& cur, const char* end, float& out) {
+    const char* begin = cur;
+    while (begin < end && is_blank(*begin)) begin++;
+
+    const char* parsed_end = begin;
+    if (parse_float_fast(begin, end, parsed_end, out) ||
+        parse_float_slow(begin, end, parsed_end, out)) {
+        cur = parsed_end;
+        return true;
+    }
+
+    out = 0.0f;
+    return false;
+}
+
+bool parse_int(const char*& cur, const char* end, int& out) {
+    const char* p = cur;
+    while (p < end && is_blank(*p)) p++;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    size_t digits = count_digits(p, end);
+    if (digits == 0) {
+        out = 0;
+        return false;
+    }
+
+    const char* digits_end = p + digits;
+    while (p < digits_end && *p == '0') p++;
+
+    int64_t value = (static_cast<size_t>(digits_end - p) > 10)
+        ? std::numeric_limits<int64_t>::max()
+        : static_cast<int64_t>(accumulate_digits(0, p, static_cast<size_t>(digits_end - p)));
+
+    if (negative) {
+        out = (value > static_cast<int64_t>(std::numeric_limits<int>::max()) + 1)
+            ? std::numeric_limits<int>::min() : static_cast<int>(-value);
+    }
+    else {
+        out = (value > std::numeric_limits<int>::max())
+            ? std::numeric_limits<int>::max() : static_cast<int>(value);
+    }
+
+    cur = digits_end;
+    return true;
+}
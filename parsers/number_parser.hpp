@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+
+// locale-independent numeric parsing shared by the obj and mtl parsers.
+// both functions mirror strtof/strtol: leading blanks are skipped, cur is advanced past
+// the consumed characters on success, and on failure out is zeroed and cur is left untouched.
+bool parse_float(const char*& cur, const char* end, float& out);
+bool parse_int(const char*& cur, const char* end, int& out);
+
+// length of the run of ascii digits starting at cur
+size_t count_digits(const char* cur, const char* end);
@@ -1,80 +1,41 @@
 #include "obj_parser.hpp"
-#include "../../ext/imgui/stb_image.h"
+#include "number_parser.hpp"
+#include "line_buffer.hpp"
+#include "../compression/decompress.hpp"
+#include "../jobs/job_system.hpp"
 #include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <iostream>
+#include <thread>
 
 
-static std::vector<unsigned char> decompress_data(const std::vector<unsigned char>& data) {
-    if (data.size() < 2 || data[0] != 0x1F || data[1] != 0x8B) {
-        return data;
-    }
-
-    int outlen = 0;
-    char* decompressed = stbi_zlib_decode_malloc(
-        reinterpret_cast<const char*>(data.data()),
-        static_cast<int>(data.size()),
-        &outlen
-    );
-
-    if (!decompressed || outlen <= 0) {
-        if (decompressed) {
-            free(decompressed);
-        }
-        return {};
-    }
-
-    std::vector<unsigned char> result(
-        reinterpret_cast<unsigned char*>(decompressed),
-        reinterpret_cast<unsigned char*>(decompressed) + outlen
-    );
-    free(decompressed);
-
-    return result;
+static inline bool is_blank(char c) {
+    return static_cast<unsigned char>(c) <= ' ';
 }
 
-static std::string clean_string(const std::vector<unsigned char>& data) {
-    std::string result;
-    result.reserve(data.size());
-
-    for (unsigned char c : data) {
-        if (c == '\0') break;
-        if (c >= 32 || c == '\n' || c == '\r' || c == '\t') {
-            result += static_cast<char>(c);
-        }
-    }
-
-    return result;
+static inline std::string_view trim_view(const char* begin, const char* end) {
+    while (begin < end && is_blank(*begin)) begin++;
+    while (end > begin && is_blank(*(end - 1))) end--;
+    return std::string_view(begin, static_cast<size_t>(end - begin));
 }
 
-static inline void trim_whitespace(std::string& str) {
-    str.erase(0, str.find_first_not_of(" \t\r\n"));
-    str.erase(str.find_last_not_of(" \t\r\n") + 1);
+static inline const char* skip_blanks(const char* cur, const char* end) {
+    while (cur < end && is_blank(*cur)) cur++;
+    return cur;
 }
 
-static inline bool parse_int(const char* str, int& out) {
-    char* end;
-    out = static_cast<int>(std::strtol(str, &end, 10));
-    return end != str;
+static inline const char* find_blank(const char* cur, const char* end) {
+    while (cur < end && !is_blank(*cur)) cur++;
+    return cur;
 }
 
-static void calculate_face_normal(c_obj_face& face, const std::vector<c_obj_vertex>& vertices) {
-    if (face.vertex_indices.size() < 3) return;
-
-    int idx0 = face.vertex_indices[0];
-    int idx1 = face.vertex_indices[1];
-    int idx2 = face.vertex_indices[2];
+static c_obj_normal calculate_face_normal(const c_obj_corner* corners, const std::vector<c_obj_vertex>& vertices) {
+    c_obj_normal normal;
 
-    if (idx0 < 0 || idx0 >= static_cast<int>(vertices.size()) ||
-        idx1 < 0 || idx1 >= static_cast<int>(vertices.size()) ||
-        idx2 < 0 || idx2 >= static_cast<int>(vertices.size())) {
-        return;
-    }
-
-    const auto& v0 = vertices[idx0];
-    const auto& v1 = vertices[idx1];
-    const auto& v2 = vertices[idx2];
+    const auto& v0 = vertices[corners[0].position];
+    const auto& v1 = vertices[corners[1].position];
+    const auto& v2 = vertices[corners[2].position];
 
     float dx1 = v1.x - v0.x;
     float dy1 = v1.y - v0.y;
@@ -90,17 +51,19 @@ static void calculate_face_normal(c_obj_face& face, const std::vector<c_obj_vert
 
     float len = std::sqrt(nx * nx + ny * ny + nz * nz);
     if (len > 0.0001f) {
-        face.normal[0] = nx / len;
-        face.normal[1] = ny / len;
-        face.normal[2] = nz / len;
+        normal.x = nx / len;
+        normal.y = ny / len;
+        normal.z = nz / len;
     }
+
+    return normal;
 }
 
-static int parse_vertex_index(const std::string& token, size_t vertex_count) {
-    if (token.empty()) return -1;
+static int parse_vertex_index(const char* begin, const char* end, size_t vertex_count) {
+    if (begin == end) return -1;
 
     int idx = 0;
-    if (!parse_int(token.c_str(), idx)) return -1;
+    if (!parse_int(begin, end, idx)) return -1;
 
     if (idx > 0) {
         return idx - 1;
@@ -115,204 +78,508 @@ static int parse_vertex_index(const std::string& token, size_t vertex_count) {
     return -1;
 }
 
-static void parse_face_line(const std::string& line, c_obj_face& face,
-    const std::vector<c_obj_vertex>& vertices,
-    const std::vector<c_obj_vertex>& tex_coords) {
-    size_t start = 0;
-    size_t pos = 0;
+// corners with an unresolvable position index are dropped, the rest are kept in order
+static void parse_face_line(std::string_view line, std::vector<c_obj_corner>& polygon,
+    size_t vertex_count, size_t tex_coord_count) {
+    const char* cur = line.data();
+    const char* end = cur + line.size();
 
-    while (pos < line.length()) {
-        if (line[pos] == ' ' || line[pos] == '\t') {
-            if (pos > start) {
-                std::string token = line.substr(start, pos - start);
+    while ((cur = skip_blanks(cur, end)) < end) {
+        const char* token = cur;
+        const char* token_end = find_blank(token, end);
+        cur = token_end;
 
-                size_t slash1 = token.find('/');
-                size_t slash2 = (slash1 != std::string::npos) ? token.find('/', slash1 + 1) : std::string::npos;
+        const char* v_end = static_cast<const char*>(std::memchr(token, '/', token_end - token));
+        if (!v_end) v_end = token_end;
 
-                std::string v_str, vt_str, vn_str;
+        const char* vt_begin = (v_end < token_end) ? v_end + 1 : token_end;
+        const char* vt_end = static_cast<const char*>(std::memchr(vt_begin, '/', token_end - vt_begin));
+        if (!vt_end) vt_end = token_end;
 
-                if (slash1 == std::string::npos) {
-                    v_str = token;
-                }
-                else {
-                    v_str = token.substr(0, slash1);
-                    if (slash2 != std::string::npos) {
-                        vt_str = token.substr(slash1 + 1, slash2 - slash1 - 1);
-                        vn_str = token.substr(slash2 + 1);
-                    }
-                    else {
-                        vt_str = token.substr(slash1 + 1);
-                    }
-                }
-
-                int v_idx = parse_vertex_index(v_str, vertices.size());
-                if (v_idx >= 0 && v_idx < static_cast<int>(vertices.size())) {
-                    face.vertex_indices.push_back(v_idx);
-                }
+        c_obj_corner corner;
+        corner.position = parse_vertex_index(token, v_end, vertex_count);
+        if (corner.position < 0 || corner.position >= static_cast<int>(vertex_count)) {
+            continue;
+        }
 
-                if (!vt_str.empty()) {
-                    int vt_idx = parse_vertex_index(vt_str, tex_coords.size());
-                    face.texcoord_indices.push_back(vt_idx);
-                }
-                else {
-                    face.texcoord_indices.push_back(-1);
-                }
+        if (vt_end > vt_begin) {
+            corner.texcoord = parse_vertex_index(vt_begin, vt_end, tex_coord_count);
+            if (corner.texcoord >= static_cast<int>(tex_coord_count)) {
+                corner.texcoord = -1;
             }
-            while (pos < line.length() && (line[pos] == ' ' || line[pos] == '\t')) pos++;
-            start = pos;
         }
-        else {
-            pos++;
+
+        polygon.push_back(corner);
+    }
+}
+
+// regroups faces so every material occupies one contiguous range, ordered by material id
+static void build_submeshes(c_obj_mesh& mesh, const std::vector<c_obj_submesh>& runs) {
+    mesh.submeshes.clear();
+
+    bool sorted = true;
+    for (size_t i = 1; i < runs.size(); i++) {
+        if (runs[i].material_id <= runs[i - 1].material_id) {
+            sorted = false;
+            break;
+        }
+    }
+
+    if (sorted) {
+        mesh.submeshes = runs;
+        return;
+    }
+
+    size_t slot_count = mesh.material_names.size() + 1;
+    std::vector<unsigned int> slot_faces(slot_count, 0);
+    for (const auto& run : runs) {
+        slot_faces[run.material_id + 1] += run.face_count;
+    }
+
+    std::vector<unsigned int> slot_offsets(slot_count, 0);
+    unsigned int offset = 0;
+    for (size_t slot = 0; slot < slot_count; slot++) {
+        slot_offsets[slot] = offset;
+        offset += slot_faces[slot];
+        if (slot_faces[slot] > 0) {
+            c_obj_submesh submesh;
+            submesh.material_id = static_cast<int>(slot) - 1;
+            submesh.first_face = slot_offsets[slot];
+            submesh.face_count = slot_faces[slot];
+            mesh.submeshes.push_back(submesh);
         }
     }
 
-    if (pos > start) {
-        std::string token = line.substr(start);
+    std::vector<c_obj_corner> indices(mesh.indices.size());
+    std::vector<c_obj_normal> normals(mesh.normals.size());
+    for (const auto& run : runs) {
+        unsigned int& dst = slot_offsets[run.material_id + 1];
+        std::copy_n(mesh.indices.begin() + run.first_face * 3, run.face_count * 3, indices.begin() + dst * 3);
+        std::copy_n(mesh.normals.begin() + run.first_face, run.face_count, normals.begin() + dst);
+        dst += run.face_count;
+    }
+
+    mesh.indices.swap(indices);
+    mesh.normals.swap(normals);
+}
+
+enum class e_obj_line {
+    skip,
+    vertex,
+    tex_coord,
+    face,
+    use_material
+};
+
+// shared by the counting and parsing passes so both agree on which lines define an index slot
+static e_obj_line classify_line(std::string_view line, std::string_view& data) {
+    if (line.size() < 2 || line[0] == '#') {
+        return e_obj_line::skip;
+    }
+
+    if (line.compare(0, 7, "usemtl ") == 0) {
+        data = trim_view(line.data() + 7, line.data() + line.size());
+        return e_obj_line::use_material;
+    }
+
+    const char* prefix_end = find_blank(line.data(), line.data() + line.size());
+    std::string_view prefix(line.data(), static_cast<size_t>(prefix_end - line.data()));
+    if (prefix.size() == line.size()) {
+        return e_obj_line::skip;
+    }
+
+    data = trim_view(prefix_end, line.data() + line.size());
+    if (prefix == "v") return e_obj_line::vertex;
+    if (prefix == "vt") return e_obj_line::tex_coord;
+    if (prefix == "f") return e_obj_line::face;
+    return e_obj_line::skip;
+}
 
-        size_t slash1 = token.find('/');
-        size_t slash2 = (slash1 != std::string::npos) ? token.find('/', slash1 + 1) : std::string::npos;
+static inline std::string_view next_line(const char*& cursor, const char* end) {
+    const char* line_end = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+    if (!line_end) {
+        line_end = end;
+    }
 
-        std::string v_str, vt_str, vn_str;
+    std::string_view line = trim_view(cursor, line_end);
+    cursor = (line_end < end) ? line_end + 1 : end;
+    return line;
+}
 
-        if (slash1 == std::string::npos) {
-            v_str = token;
+// one newline-aligned slice of the obj text. positions and uvs are written into the model at
+// vertex_base / tex_coord_base, faces are collected locally and spliced in afterwards
+struct c_obj_chunk {
+    std::string_view text;
+
+    // filled by the counting pass
+    size_t vertex_count = 0;
+    size_t tex_coord_count = 0;
+    std::vector<std::string_view> used_materials;
+
+    // parse cursor, persists across calls so a chunk can also be fed piecewise
+    size_t vertex_cursor = 0;
+    size_t tex_coord_cursor = 0;
+    int current_material = -1;
+
+    std::vector<c_obj_corner> indices;
+    std::vector<c_obj_submesh> runs;
+    std::vector<c_obj_corner> polygon;
+};
+
+// usemtl lines are rare, so keys own their storage and stay valid when the source text is transient
+struct c_obj_material_table {
+    std::unordered_map<std::string, int>* ids = nullptr;
+    std::vector<std::string>* names = nullptr;
+    bool frozen = false;
+
+    int intern(std::string_view name) {
+        std::string key(name);
+        auto it = ids->find(key);
+        if (it != ids->end()) {
+            return it->second;
         }
-        else {
-            v_str = token.substr(0, slash1);
-            if (slash2 != std::string::npos) {
-                vt_str = token.substr(slash1 + 1, slash2 - slash1 - 1);
-                vn_str = token.substr(slash2 + 1);
-            }
-            else {
-                vt_str = token.substr(slash1 + 1);
-            }
+        if (frozen) {
+            return -1;
         }
 
-        int v_idx = parse_vertex_index(v_str, vertices.size());
-        if (v_idx >= 0 && v_idx < static_cast<int>(vertices.size())) {
-            face.vertex_indices.push_back(v_idx);
+        int id = static_cast<int>(names->size());
+        names->push_back(key);
+        ids->emplace(std::move(key), id);
+        return id;
+    }
+};
+
+static constexpr size_t parallel_min_bytes = 1u << 20;
+static constexpr size_t parallel_min_chunk_bytes = 256u << 10;
+static constexpr int parallel_max_threads = 8;
+
+static void count_chunk(c_obj_chunk& chunk) {
+    const char* cursor = chunk.text.data();
+    const char* text_end = cursor + chunk.text.size();
+
+    while (cursor < text_end) {
+        std::string_view data;
+        switch (classify_line(next_line(cursor, text_end), data)) {
+        case e_obj_line::vertex: chunk.vertex_count++; break;
+        case e_obj_line::tex_coord: chunk.tex_coord_count++; break;
+        case e_obj_line::use_material: chunk.used_materials.push_back(data); break;
+        default: break;
         }
+    }
+}
+
+// append mode grows the model arrays as lines are read, otherwise they were sized by the counting pass
+static void parse_lines(std::string_view text, c_obj_chunk& chunk, c_obj_model& model, c_obj_material_table& materials, bool append) {
+    std::vector<c_obj_corner>& polygon = chunk.polygon;
+    int current_material = chunk.current_material;
+    size_t vertex_count = chunk.vertex_cursor;
+    size_t tex_coord_count = chunk.tex_coord_cursor;
 
-        if (!vt_str.empty()) {
-            int vt_idx = parse_vertex_index(vt_str, tex_coords.size());
-            face.texcoord_indices.push_back(vt_idx);
+    const char* cursor = text.data();
+    const char* text_end = cursor + text.size();
+
+    while (cursor < text_end) {
+        std::string_view data;
+        e_obj_line type = classify_line(next_line(cursor, text_end), data);
+
+        const char* cur = data.data();
+        const char* end = cur + data.size();
+
+        if (type == e_obj_line::use_material) {
+            current_material = materials.intern(data);
+        }
+        else if (type == e_obj_line::vertex) {
+            c_obj_vertex v;
+            parse_float(cur, end, v.x);
+            parse_float(cur, end, v.y);
+            parse_float(cur, end, v.z);
+            if (append) model.vertices.push_back(v);
+            else model.vertices[vertex_count] = v;
+            vertex_count++;
         }
-        else {
-            face.texcoord_indices.push_back(-1);
+        else if (type == e_obj_line::tex_coord) {
+            c_obj_vertex vt;
+            parse_float(cur, end, vt.u);
+            parse_float(cur, end, vt.v);
+            if (append) model.tex_coords.push_back(vt);
+            else model.tex_coords[tex_coord_count] = vt;
+            tex_coord_count++;
         }
-    }
+        else if (type == e_obj_line::face) {
+            polygon.clear();
+            parse_face_line(data, polygon, vertex_count, tex_coord_count);
+            if (polygon.size() < 3) {
+                continue;
+            }
 
-    while (face.texcoord_indices.size() < face.vertex_indices.size()) {
-        face.texcoord_indices.push_back(-1);
-    }
-}
+            if (chunk.runs.empty() || chunk.runs.back().material_id != current_material) {
+                c_obj_submesh run;
+                run.material_id = current_material;
+                run.first_face = static_cast<unsigned int>(chunk.indices.size() / 3);
+                chunk.runs.push_back(run);
+            }
 
-bool parse_obj(const std::vector<unsigned char>& obj_data, c_obj_model& model) {
-    if (obj_data.empty()) {
-        return false;
+            // polygons are fanned around their first corner
+            for (size_t i = 1; i + 1 < polygon.size(); i++) {
+                chunk.indices.push_back(polygon[0]);
+                chunk.indices.push_back(polygon[i]);
+                chunk.indices.push_back(polygon[i + 1]);
+                chunk.runs.back().face_count++;
+            }
+        }
     }
 
-    std::vector<unsigned char> decompressed = decompress_data(obj_data);
-    if (decompressed.empty()) {
-        return false;
-    }
+    chunk.current_material = current_material;
+    chunk.vertex_cursor = vertex_count;
+    chunk.tex_coord_cursor = tex_coord_count;
+}
 
-    std::string content = clean_string(decompressed);
-    if (content.size() < 10 || content.find("v ") == std::string::npos) {
-        return false;
+static void calculate_normals(c_obj_mesh& mesh, const std::vector<c_obj_vertex>& vertices, size_t first_face, size_t last_face) {
+    for (size_t i = first_face; i < last_face; i++) {
+        mesh.normals[i] = calculate_face_normal(&mesh.indices[i * 3], vertices);
     }
+}
 
+static void reset_model(c_obj_model& model) {
     model.vertices.clear();
     model.tex_coords.clear();
-    model.faces.clear();
+    model.mesh.clear();
+    model.render_mesh.clear();
+    model.lods.reset();
     model.materials.clear();
+    model.material_ids.clear();
     model.valid = false;
+}
+
+// runs task(0..count-1), one on the calling thread and the rest on the job system
+template <typename t_task>
+static void run_parallel(size_t count, const t_task& task) {
+    c_job_system::get().parallel_for(count, task);
+}
 
-    model.vertices.reserve(10000);
-    model.tex_coords.reserve(10000);
-    model.faces.reserve(5000);
+static bool finalize_model(c_obj_model& model, const std::vector<c_obj_submesh>& runs, size_t max_tasks) {
+    size_t face_count = model.mesh.indices.size() / 3;
+    model.mesh.normals.resize(face_count);
 
-    std::string current_material = "";
+    size_t normal_tasks = std::min(max_tasks, std::max<size_t>(face_count / 4096, 1));
+    run_parallel(normal_tasks, [&](size_t i) {
+        calculate_normals(model.mesh, model.vertices, face_count * i / normal_tasks, face_count * (i + 1) / normal_tasks);
+    });
 
-    size_t line_start = 0;
-    size_t content_len = content.length();
+    build_submeshes(model.mesh, runs);
+    build_render_mesh(model);
+    model.materials.resize(model.mesh.material_names.size());
 
-    int face_debug_count = 0;
-    int material_switch_count = 0;
-    int tex_coord_count = 0;
-    int line_number = 0;
-    bool showed_vt_samples = false;
+    model.valid = !model.vertices.empty() && model.mesh.face_count() > 0;
+    return model.valid;
+}
 
-    while (line_start < content_len) {
-        size_t line_end = content.find('\n', line_start);
-        if (line_end == std::string::npos) {
-            line_end = content_len;
+void build_render_mesh(c_obj_model& model) {
+    c_obj_render_mesh& render = model.render_mesh;
+    const std::vector<c_obj_corner>& corners = model.mesh.indices;
+    render.clear();
+    render.indices.reserve(corners.size());
+    render.vertices.reserve(std::min(corners.size(), model.vertices.size() + model.tex_coords.size()));
+
+    // per-position chains of the welded vertices already emitted for it. a position rarely
+    // carries more than a couple of uvs (seams), so walking the chain beats hashing pairs
+    std::vector<int> first_welded(model.vertices.size(), -1);
+    std::vector<int> next_welded;
+    std::vector<int> welded_texcoord;
+    next_welded.reserve(render.vertices.capacity());
+    welded_texcoord.reserve(render.vertices.capacity());
+
+    const int tex_coord_count = static_cast<int>(model.tex_coords.size());
+    for (const auto& corner : corners) {
+        if (corner.position < 0 || corner.position >= static_cast<int>(model.vertices.size())) {
+            render.clear();
+            return;
         }
 
-        std::string line = content.substr(line_start, line_end - line_start);
-        line_start = line_end + 1;
-        line_number++;
+        const int texcoord = (corner.texcoord >= 0 && corner.texcoord < tex_coord_count) ? corner.texcoord : -1;
+        int welded = first_welded[corner.position];
+        while (welded >= 0 && welded_texcoord[welded] != texcoord) {
+            welded = next_welded[welded];
+        }
 
-        trim_whitespace(line);
-        if (line.empty() || line[0] == '#') {
-            continue;
+        if (welded < 0) {
+            welded = static_cast<int>(render.vertices.size());
+            const c_obj_vertex& position = model.vertices[corner.position];
+            c_obj_render_vertex vertex;
+            vertex.x = position.x;
+            vertex.y = position.y;
+            vertex.z = position.z;
+            if (texcoord >= 0) {
+                vertex.u = model.tex_coords[texcoord].u;
+                vertex.v = model.tex_coords[texcoord].v;
+                vertex.has_uv = true;
+            }
+            render.vertices.push_back(vertex);
+            welded_texcoord.push_back(texcoord);
+            next_welded.push_back(first_welded[corner.position]);
+            first_welded[corner.position] = welded;
         }
 
-        if (line.length() < 2) continue;
+        render.indices.push_back(static_cast<unsigned int>(welded));
+    }
+}
 
-        if (line.compare(0, 7, "usemtl ") == 0) {
-            current_material = line.substr(7);
-            trim_whitespace(current_material);
-            material_switch_count++;
-            continue;
+static size_t pick_chunk_count(size_t text_size, int max_threads) {
+    if (max_threads == 1 || text_size < parallel_min_bytes) {
+        return 1;
+    }
+
+    size_t threads = (max_threads > 0) ? static_cast<size_t>(max_threads) : std::thread::hardware_concurrency();
+    threads = std::min(threads, static_cast<size_t>(parallel_max_threads));
+    threads = std::min(threads, text_size / parallel_min_chunk_bytes);
+    return std::max<size_t>(threads, 1);
+}
+
+static std::vector<c_obj_chunk> split_chunks(std::string_view text, size_t chunk_count) {
+    std::vector<c_obj_chunk> chunks;
+    chunks.reserve(chunk_count);
+
+    size_t begin = 0;
+    for (size_t i = 0; i < chunk_count && begin < text.size(); i++) {
+        size_t end = text.size();
+        if (i + 1 < chunk_count) {
+            size_t target = std::max(begin, text.size() * (i + 1) / chunk_count);
+            size_t newline = text.find('\n', target);
+            end = (newline == std::string_view::npos) ? text.size() : newline + 1;
         }
 
-        size_t space_pos = line.find(' ');
-        if (space_pos == std::string::npos) space_pos = line.find('\t');
-        if (space_pos == std::string::npos) continue;
+        c_obj_chunk& chunk = chunks.emplace_back();
+        chunk.text = text.substr(begin, end - begin);
+        begin = end;
+    }
 
-        std::string prefix = line.substr(0, space_pos);
-        std::string data = line.substr(space_pos + 1);
-        trim_whitespace(data);
+    return chunks;
+}
 
-        if (prefix == "v") {
-            c_obj_vertex v;
-            const char* str = data.c_str();
-            char* end;
-            v.x = std::strtof(str, &end);
-            if (end == str) continue;
-            v.y = std::strtof(end, &end);
-            if (end == str) continue;
-            v.z = std::strtof(end, &end);
-            model.vertices.push_back(v);
+bool parse_obj(const std::vector<unsigned char>& obj_data, c_obj_model& model, int max_threads) {
+    if (obj_data.empty()) {
+        return false;
+    }
+
+    if (is_compressed(obj_data.data(), obj_data.size())) {
+        c_pooled_buffer decompressed;
+        if (!decompress(obj_data.data(), obj_data.size(), decompressed.data()) || decompressed.data().empty()) {
+            return false;
         }
-        else if (prefix == "vt") {
-            c_obj_vertex vt;
-            const char* str = data.c_str();
-            char* end;
-            vt.u = std::strtof(str, &end);
-            if (end == str) continue;
-            vt.v = std::strtof(end, &end);
-            model.tex_coords.push_back(vt);
-            tex_coord_count++;
+        const std::vector<unsigned char>& text = decompressed.data();
+        return parse_obj(std::string_view(reinterpret_cast<const char*>(text.data()), text.size()), model, max_threads);
+    }
+
+    return parse_obj(std::string_view(reinterpret_cast<const char*>(obj_data.data()), obj_data.size()), model, max_threads);
+}
+
+bool parse_obj(std::string_view obj_text, c_obj_model& model, int max_threads) {
+    size_t terminator = obj_text.find('\0');
+    if (terminator != std::string_view::npos) {
+        obj_text = obj_text.substr(0, terminator);
+    }
+
+    if (obj_text.size() < 10 || obj_text.find("v ") == std::string_view::npos) {
+        return false;
+    }
+
+    reset_model(model);
+
+    c_obj_material_table materials;
+    materials.ids = &model.material_ids;
+    materials.names = &model.mesh.material_names;
+
+    std::vector<c_obj_chunk> chunks = split_chunks(obj_text, pick_chunk_count(obj_text.size(), max_threads));
+    std::vector<c_obj_submesh> runs;
 
-            if (tex_coord_count == 5) {
-                showed_vt_samples = true;
+    if (chunks.size() == 1) {
+        model.vertices.reserve(10000);
+        model.tex_coords.reserve(10000);
+        chunks[0].indices.reserve(15000);
+
+        parse_lines(chunks[0].text, chunks[0], model, materials, true);
+        model.mesh.indices = std::move(chunks[0].indices);
+        runs = std::move(chunks[0].runs);
+    }
+    else {
+        run_parallel(chunks.size(), [&chunks](size_t i) { count_chunk(chunks[i]); });
+
+        // prefix sums give every chunk its absolute vertex offsets and the material active at its start
+        size_t vertex_total = 0;
+        size_t tex_coord_total = 0;
+        int active_material = -1;
+        for (auto& chunk : chunks) {
+            chunk.vertex_cursor = vertex_total;
+            chunk.tex_coord_cursor = tex_coord_total;
+            chunk.current_material = active_material;
+            vertex_total += chunk.vertex_count;
+            tex_coord_total += chunk.tex_coord_count;
+
+            for (std::string_view name : chunk.used_materials) {
+                active_material = materials.intern(name);
             }
         }
-        else if (prefix == "f") {
-            c_obj_face face;
-            face.material_name = current_material;
+        materials.frozen = true;
 
-            parse_face_line(data, face, model.vertices, model.tex_coords);
+        model.vertices.resize(vertex_total);
+        model.tex_coords.resize(tex_coord_total);
 
-            if (face.vertex_indices.size() >= 3) {
-                calculate_face_normal(face, model.vertices);
-                model.faces.push_back(face);
+        run_parallel(chunks.size(), [&](size_t i) { parse_lines(chunks[i].text, chunks[i], model, materials, false); });
+
+        size_t index_total = 0;
+        for (const auto& chunk : chunks) {
+            index_total += chunk.indices.size();
+        }
+        model.mesh.indices.reserve(index_total);
+
+        for (auto& chunk : chunks) {
+            unsigned int face_offset = static_cast<unsigned int>(model.mesh.indices.size() / 3);
+            for (c_obj_submesh run : chunk.runs) {
+                if (!runs.empty() && runs.back().material_id == run.material_id) {
+                    runs.back().face_count += run.face_count;
+                    continue;
+                }
+                run.first_face += face_offset;
+                runs.push_back(run);
             }
+
+            model.mesh.indices.insert(model.mesh.indices.end(), chunk.indices.begin(), chunk.indices.end());
+            std::vector<c_obj_corner>().swap(chunk.indices);
         }
     }
 
-    model.valid = !model.vertices.empty() && !model.faces.empty();
-    return model.valid;
-}
\ No newline at end of file
+    return finalize_model(model, runs, chunks.size());
+}
+
+struct c_obj_stream_state {
+    c_obj_chunk chunk;
+    c_obj_material_table materials;
+    c_line_buffer lines;
+};
+
+c_obj_stream_parser::c_obj_stream_parser(c_obj_model& model)
+    : model_(model), state_(std::make_unique<c_obj_stream_state>()) {
+    reset_model(model_);
+    state_->materials.ids = &model_.material_ids;
+    state_->materials.names = &model_.mesh.material_names;
+}
+
+c_obj_stream_parser::~c_obj_stream_parser() = default;
+
+bool c_obj_stream_parser::write(const char* data, size_t size) {
+    c_obj_stream_state& state = *state_;
+    state.lines.write(std::string_view(data, size), [&](std::string_view text) {
+        parse_lines(text, state.chunk, model_, state.materials, true);
+    });
+    return true;
+}
+
+bool c_obj_stream_parser::finish() {
+    c_obj_stream_state& state = *state_;
+    state.lines.flush([&](std::string_view text) {
+        parse_lines(text, state.chunk, model_, state.materials, true);
+    });
+
+    model_.mesh.indices = std::move(state.chunk.indices);
+    return finalize_model(model_, state.chunk.runs, 1);
+}
@@ -1,6 +1,9 @@
 #pragma once
+#include <array>
+#include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 struct c_obj_vertex {
@@ -16,22 +19,164 @@ struct c_obj_material {
     std::string diffuse_texture;
     int texture_index = -1;
     float sampled_color[3] = {0.8f, 0.8f, 0.8f};
+    bool defined = false; // set once an mtl declares it, usemtl names without a newmtl stay undefined
 };
 
+struct c_obj_corner {
+    int position = -1;
+    int texcoord = -1;
+};
+
+struct c_obj_normal {
+    float x = 0.0f, y = 1.0f, z = 0.0f;
+};
+
+// contiguous run of faces sharing one material, ranges are sorted by material_id
+struct c_obj_submesh {
+    int material_id = -1;
+    unsigned int first_face = 0;
+    unsigned int face_count = 0;
+};
+
+// flattened triangle list: three corners per face in indices, one normal per face
+struct c_obj_mesh {
+    std::vector<c_obj_corner> indices;
+    std::vector<c_obj_normal> normals;
+    std::vector<c_obj_submesh> submeshes;
+    std::vector<std::string> material_names;
+
+    size_t face_count() const { return normals.size(); }
+
+    void clear() {
+        indices.clear();
+        normals.clear();
+        submeshes.clear();
+        material_names.clear();
+    }
+};
+
+// one welded vertex per unique (position, texcoord) pair referenced by the mesh
+struct c_obj_render_vertex {
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+    float u = 0.0f, v = 0.0f;
+    bool has_uv = false;
+};
+
+// indexed triangle list over welded vertices, faces are in the same order as c_obj_mesh so
+// submesh ranges and per-face normals apply unchanged. lets a renderer transform each shared
+// vertex once per frame instead of once per adjacent face
+struct c_obj_render_mesh {
+    std::vector<c_obj_render_vertex> vertices;
+    std::vector<unsigned int> indices;
+
+    // average number of corners sharing each welded vertex, 1.0 means nothing was shared
+    float reuse_ratio() const {
+        return vertices.empty() ? 0.0f : static_cast<float>(indices.size()) / static_cast<float>(vertices.size());
+    }
+
+    void clear() {
+        vertices.clear();
+        indices.clear();
+    }
+};
+
+// by-value view of a single triangle in c_obj_mesh, built on demand for older call sites
 struct c_obj_face {
-    std::vector<int> vertex_indices;
-    std::vector<int> texcoord_indices;
-    std::string material_name;
+    std::array<int, 3> vertex_indices = {-1, -1, -1};
+    std::array<int, 3> texcoord_indices = {-1, -1, -1};
+    int material_id = -1;
     float normal[3] = {0.0f, 1.0f, 0.0f};
 };
 
+// simplified levels of render_mesh, see mesh/mesh_lod.hpp
+struct c_obj_lod_chain;
+
 struct c_obj_model {
     std::vector<c_obj_vertex> vertices;
     std::vector<c_obj_vertex> tex_coords;
-    std::vector<c_obj_face> faces;
-    std::unordered_map<std::string, c_obj_material> materials;
-    std::string current_material;
+    c_obj_mesh mesh;
+    c_obj_render_mesh render_mesh;
+    std::shared_ptr<c_obj_lod_chain> lods;
+
+    // dense and indexed by material id, the same ids submeshes carry. names live in mesh.material_names
+    std::vector<c_obj_material> materials;
+    std::unordered_map<std::string, int> material_ids;
     bool valid = false;
+
+    size_t face_count() const { return mesh.face_count(); }
+
+    const c_obj_material* material(int id) const {
+        if (id < 0 || id >= static_cast<int>(materials.size()) || !materials[id].defined) {
+            return nullptr;
+        }
+        return &materials[id];
+    }
+
+    int find_material_id(const std::string& name) const {
+        auto it = material_ids.find(name);
+        return (it != material_ids.end()) ? it->second : -1;
+    }
+
+    // returns the id for name, appending a new (undefined) material the first time it is seen
+    int intern_material(const std::string& name) {
+        auto it = material_ids.find(name);
+        if (it != material_ids.end()) {
+            return it->second;
+        }
+
+        int id = static_cast<int>(mesh.material_names.size());
+        mesh.material_names.push_back(name);
+        materials.resize(mesh.material_names.size());
+        material_ids.emplace(name, id);
+        return id;
+    }
+
+    c_obj_face face(size_t index) const {
+        c_obj_face face;
+        for (int j = 0; j < 3; j++) {
+            const c_obj_corner& corner = mesh.indices[index * 3 + j];
+            face.vertex_indices[j] = corner.position;
+            face.texcoord_indices[j] = corner.texcoord;
+        }
+
+        const c_obj_normal& normal = mesh.normals[index];
+        face.normal[0] = normal.x;
+        face.normal[1] = normal.y;
+        face.normal[2] = normal.z;
+
+        for (const auto& submesh : mesh.submeshes) {
+            if (index >= submesh.first_face && index < submesh.first_face + submesh.face_count) {
+                face.material_id = submesh.material_id;
+                break;
+            }
+        }
+
+        return face;
+    }
 };
 
-bool parse_obj(const std::vector<unsigned char>& obj_data, c_obj_model& model);
\ No newline at end of file
+// max_threads: 0 picks automatically (serial below ~1 MB of text), 1 forces the serial path
+bool parse_obj(const std::vector<unsigned char>& obj_data, c_obj_model& model, int max_threads = 0);
+
+// parses already-decompressed obj text in place, no intermediate copies
+bool parse_obj(std::string_view obj_text, c_obj_model& model, int max_threads = 0);
+
+// welds mesh corners into model.render_mesh, called by the parsers once a model is complete
+void build_render_mesh(c_obj_model& model);
+
+struct c_obj_stream_state;
+
+// incremental parser for obj text arriving in arbitrary pieces, e.g. straight out of a download.
+// complete lines are parsed as soon as they arrive, only a partial trailing line is buffered
+class c_obj_stream_parser {
+public:
+    explicit c_obj_stream_parser(c_obj_model& model);
+    ~c_obj_stream_parser();
+
+    bool write(const char* data, size_t size);
+    bool finish();
+
+private:
+    c_obj_model& model_;
+    std::unique_ptr<c_obj_stream_state> state_;
+};
@@ -1,187 +1,1037 @@
 #include "texture_cache.hpp"
+#include "../cache/texture_disk_cache.hpp"
+#include "../jobs/job_system.hpp"
 #include "../../ext/imgui/stb_image.h"
 #include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <string_view>
 
 
-c_texture_cache::~c_texture_cache() {
-    if (running_.load(std::memory_order_acquire)) {
-        running_.store(false, std::memory_order_release);
-        queue_cv_.notify_all();
-        for (auto& worker : workers_) {
-            if (worker.joinable()) {
-                worker.join();
+void c_decoded_texture::build_mips() {
+    mips.clear();
+    const unsigned char* src = pixels.data();
+    int src_width = width;
+    int src_height = height;
+
+    while (src && (src_width > 1 || src_height > 1)) {
+        int dst_width = (src_width > 1) ? src_width / 2 : 1;
+        int dst_height = (src_height > 1) ? src_height / 2 : 1;
+        std::vector<unsigned char> level(static_cast<size_t>(dst_width) * dst_height * 4);
+
+        // odd edges clamp so the last row/column is not dropped from the average
+        for (int y = 0; y < dst_height; y++) {
+            const unsigned char* row0 = src + static_cast<size_t>(std::min(y * 2, src_height - 1)) * src_width * 4;
+            const unsigned char* row1 = src + static_cast<size_t>(std::min(y * 2 + 1, src_height - 1)) * src_width * 4;
+            unsigned char* dst = level.data() + static_cast<size_t>(y) * dst_width * 4;
+            for (int x = 0; x < dst_width; x++) {
+                int x0 = std::min(x * 2, src_width - 1) * 4;
+                int x1 = std::min(x * 2 + 1, src_width - 1) * 4;
+                for (int c = 0; c < 4; c++) {
+                    dst[x * 4 + c] = static_cast<unsigned char>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+                }
+            }
+        }
+
+        c_texture_mip mip;
+        mip.width = dst_width;
+        mip.height = dst_height;
+        mip.pixels = c_texel_buffer::from_vector(std::move(level));
+        mips.push_back(std::move(mip));
+
+        src = mips.back().pixels.data();
+        src_width = dst_width;
+        src_height = dst_height;
+    }
+}
+
+static c_texel_buffer tile_texels(const unsigned char* src, int width, int height) {
+    const int padded_width = (width + 3) & ~3;
+    const int padded_height = (height + 3) & ~3;
+    std::vector<unsigned char> tiled(static_cast<size_t>(padded_width) * padded_height * 4);
+
+    // padding repeats the edge texels so a block is never partly garbage
+    for (int y = 0; y < padded_height; y++) {
+        const unsigned char* row = src + static_cast<size_t>(std::min(y, height - 1)) * width * 4;
+        for (int x = 0; x < padded_width; x++) {
+            std::memcpy(tiled.data() + texel_offset<e_texel_layout::tiled>(x, y, width),
+                row + std::min(x, width - 1) * 4, 4);
+        }
+    }
+
+    return c_texel_buffer::from_vector(std::move(tiled));
+}
+
+void c_decoded_texture::convert_to_tiled() {
+    if (layout == e_texel_layout::tiled || format != e_texel_format::rgba8 || pixels.empty()) {
+        return;
+    }
+
+    pixels = tile_texels(pixels.data(), width, height);
+    for (auto& mip : mips) {
+        mip.pixels = tile_texels(mip.pixels.data(), mip.width, mip.height);
+    }
+    layout = e_texel_layout::tiled;
+}
+
+static uint32_t load_rgba(const unsigned char* texel) {
+    uint32_t color;
+    std::memcpy(&color, texel, sizeof(color));
+    return color;
+}
+
+static int color_distance(uint32_t a, uint32_t b) {
+    int distance = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const int delta = static_cast<int>((a >> shift) & 0xFF) - static_cast<int>((b >> shift) & 0xFF);
+        distance += delta * delta;
+    }
+    return distance;
+}
+
+// base level colours must all fit the palette exactly, mip texels (box averages of them) take the nearest entry
+static bool palettize_level(const unsigned char* src, size_t texel_count, bool exact, std::vector<uint32_t>& palette,
+                            std::unordered_map<uint32_t, unsigned char>& lookup, std::vector<unsigned char>& indices) {
+    indices.resize(texel_count);
+    uint32_t last_color = 0;
+    unsigned char last_index = 0;
+    bool has_last = false;
+
+    for (size_t i = 0; i < texel_count; i++) {
+        const uint32_t color = load_rgba(src + i * 4);
+        if (has_last && color == last_color) {
+            indices[i] = last_index;
+            continue;
+        }
+
+        auto it = lookup.find(color);
+        unsigned char index = 0;
+        if (it != lookup.end()) {
+            index = it->second;
+        }
+        else if (exact) {
+            if (palette.size() >= 256) {
+                return false;
             }
+            index = static_cast<unsigned char>(palette.size());
+            palette.push_back(color);
+            lookup.emplace(color, index);
         }
+        else {
+            int best = color_distance(color, palette[0]);
+            for (size_t p = 1; p < palette.size() && best > 0; p++) {
+                const int distance = color_distance(color, palette[p]);
+                if (distance < best) {
+                    best = distance;
+                    index = static_cast<unsigned char>(p);
+                }
+            }
+            lookup.emplace(color, index);
+        }
+
+        indices[i] = index;
+        last_color = color;
+        last_index = index;
+        has_last = true;
     }
+    return true;
+}
+
+static uint32_t to_rgb565(const float (&color)[3]) {
+    const auto quantize = [](float value, int max) {
+        return static_cast<uint32_t>(std::clamp(static_cast<int>(value * max / 255.0f + 0.5f), 0, max));
+    };
+    return (quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31);
 }
 
-void c_texture_cache::initialize(int worker_count) {
+// endpoints are the extremes of the opaque texels along their principal axis. blocks with any texel
+// under half alpha use the 3 colour mode, whose fourth code is transparent black
+static void encode_bc1_block(const uint32_t (&texels)[16], unsigned char* out) {
+    bool transparent[16];
+    int opaque_count = 0;
+    float mean[3] = {};
+    for (int i = 0; i < 16; i++) {
+        transparent[i] = (texels[i] >> 24) < 128;
+        if (!transparent[i]) {
+            for (int c = 0; c < 3; c++) {
+                mean[c] += static_cast<float>((texels[i] >> (c * 8)) & 0xFF);
+            }
+            opaque_count++;
+        }
+    }
+
+    if (opaque_count == 0) {
+        std::memset(out, 0, 4);
+        std::memset(out + 4, 0xFF, 4);
+        return;
+    }
+
+    float covariance[6] = {};
+    for (int c = 0; c < 3; c++) {
+        mean[c] /= static_cast<float>(opaque_count);
+    }
+    for (int i = 0; i < 16; i++) {
+        if (transparent[i]) {
+            continue;
+        }
+        float d[3];
+        for (int c = 0; c < 3; c++) {
+            d[c] = static_cast<float>((texels[i] >> (c * 8)) & 0xFF) - mean[c];
+        }
+        covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+    }
+
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 4; iteration++) {
+        const float next[3] = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]};
+        const float length = std::max({std::abs(next[0]), std::abs(next[1]), std::abs(next[2])});
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < 3; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float min_projection = 0.0f, max_projection = 0.0f;
+    float low[3] = {}, high[3] = {};
+    bool first = true;
+    for (int i = 0; i < 16; i++) {
+        if (transparent[i]) {
+            continue;
+        }
+        float color[3];
+        float projection = 0.0f;
+        for (int c = 0; c < 3; c++) {
+            color[c] = static_cast<float>((texels[i] >> (c * 8)) & 0xFF);
+            projection += (color[c] - mean[c]) * axis[c];
+        }
+        if (first || projection < min_projection) {
+            min_projection = projection;
+            std::copy_n(color, 3, low);
+        }
+        if (first || projection > max_projection) {
+            max_projection = projection;
+            std::copy_n(color, 3, high);
+        }
+        first = false;
+    }
+
+    const bool three_color = opaque_count < 16;
+    uint32_t c0 = to_rgb565(high);
+    uint32_t c1 = to_rgb565(low);
+    if (three_color ? (c0 > c1) : (c0 < c1)) {
+        std::swap(c0, c1);
+    }
+
+    uint32_t palette[4];
+    for (uint32_t code = 0; code < 4; code++) {
+        palette[code] = bc1_color(c0, c1, code);
+    }
+    const uint32_t usable_codes = (c0 > c1) ? 4 : 3;
+
+    out[0] = static_cast<unsigned char>(c0 & 0xFF);
+    out[1] = static_cast<unsigned char>(c0 >> 8);
+    out[2] = static_cast<unsigned char>(c1 & 0xFF);
+    out[3] = static_cast<unsigned char>(c1 >> 8);
+    for (int y = 0; y < 4; y++) {
+        unsigned char row = 0;
+        for (int x = 0; x < 4; x++) {
+            const int i = y * 4 + x;
+            uint32_t best_code = 3;
+            if (!transparent[i]) {
+                best_code = 0;
+                int best = color_distance(texels[i] | 0xFF000000u, palette[0]);
+                for (uint32_t code = 1; code < usable_codes; code++) {
+                    const int distance = color_distance(texels[i] | 0xFF000000u, palette[code]);
+                    if (distance < best) {
+                        best = distance;
+                        best_code = code;
+                    }
+                }
+            }
+            row |= static_cast<unsigned char>(best_code << (x * 2));
+        }
+        out[4 + y] = row;
+    }
+}
+
+// partial blocks on the right and bottom edges repeat the last texels
+static c_texel_buffer encode_bc1(const unsigned char* src, int width, int height) {
+    const int blocks_x = (width + 3) >> 2;
+    const int blocks_y = (height + 3) >> 2;
+    std::vector<unsigned char> blocks(static_cast<size_t>(blocks_x) * blocks_y * 8);
+
+    for (int by = 0; by < blocks_y; by++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            uint32_t texels[16];
+            for (int y = 0; y < 4; y++) {
+                const int sy = std::min(by * 4 + y, height - 1);
+                for (int x = 0; x < 4; x++) {
+                    const int sx = std::min(bx * 4 + x, width - 1);
+                    texels[y * 4 + x] = load_rgba(src + (static_cast<size_t>(sy) * width + sx) * 4);
+                }
+            }
+            encode_bc1_block(texels, blocks.data() + (static_cast<size_t>(by) * blocks_x + bx) * 8);
+        }
+    }
+
+    return c_texel_buffer::from_vector(std::move(blocks));
+}
+
+bool c_decoded_texture::compress(e_texture_compression compression) {
+    if (compression == e_texture_compression::none || pixels.empty() ||
+        format != e_texel_format::rgba8 || layout != e_texel_layout::linear) {
+        return false;
+    }
+
+    std::vector<uint32_t> colors;
+    std::unordered_map<uint32_t, unsigned char> lookup;
+    std::vector<unsigned char> indices;
+    if (palettize_level(pixels.data(), static_cast<size_t>(width) * height, true, colors, lookup, indices)) {
+        pixels = c_texel_buffer::from_vector(std::move(indices));
+        for (auto& mip : mips) {
+            std::vector<unsigned char> mip_indices;
+            palettize_level(mip.pixels.data(), static_cast<size_t>(mip.width) * mip.height, false, colors, lookup, mip_indices);
+            mip.pixels = c_texel_buffer::from_vector(std::move(mip_indices));
+        }
+
+        std::vector<unsigned char> entries(colors.size() * 4);
+        std::memcpy(entries.data(), colors.data(), entries.size());
+        palette = c_texel_buffer::from_vector(std::move(entries));
+        format = e_texel_format::palette;
+        return true;
+    }
+
+    if (compression != e_texture_compression::bc1) {
+        return false;
+    }
+
+    pixels = encode_bc1(pixels.data(), width, height);
+    for (auto& mip : mips) {
+        mip.pixels = encode_bc1(mip.pixels.data(), mip.width, mip.height);
+    }
+    format = e_texel_format::bc1;
+    return true;
+}
+
+// lanczos with two lobes, sharp enough to keep fabric detail and with little ringing
+static float lanczos2(float x) {
+    x = std::abs(x);
+    if (x < 1e-6f) {
+        return 1.0f;
+    }
+    if (x >= 2.0f) {
+        return 0.0f;
+    }
+    const float pi_x = 3.14159265f * x;
+    return 2.0f * std::sin(pi_x) * std::sin(pi_x * 0.5f) / (pi_x * pi_x);
+}
+
+// per output texel: stride source indices (clamped to the edge) and their normalized weights
+struct c_resample_taps {
+    int stride = 0;
+    std::vector<int> indices;
+    std::vector<float> weights;
+};
+
+static c_resample_taps build_resample_taps(int src_size, int dst_size) {
+    // the kernel is stretched by the reduction ratio so it low-passes before dropping texels
+    const float ratio = static_cast<float>(src_size) / static_cast<float>(dst_size);
+    const float support = 2.0f * ratio;
+
+    c_resample_taps taps;
+    taps.stride = static_cast<int>(std::ceil(support)) * 2 + 1;
+    taps.indices.resize(static_cast<size_t>(dst_size) * taps.stride);
+    taps.weights.resize(static_cast<size_t>(dst_size) * taps.stride);
+
+    for (int i = 0; i < dst_size; i++) {
+        const float center = (i + 0.5f) * ratio - 0.5f;
+        const int first = static_cast<int>(std::floor(center - support)) + 1;
+        int* indices = taps.indices.data() + static_cast<size_t>(i) * taps.stride;
+        float* weights = taps.weights.data() + static_cast<size_t>(i) * taps.stride;
+
+        float sum = 0.0f;
+        for (int k = 0; k < taps.stride; k++) {
+            indices[k] = std::clamp(first + k, 0, src_size - 1);
+            weights[k] = lanczos2((first + k - center) / ratio);
+            sum += weights[k];
+        }
+        for (int k = 0; k < taps.stride; k++) {
+            weights[k] /= sum;
+        }
+    }
+
+    return taps;
+}
+
+// separable: rows into a float buffer first, then the columns are accumulated a whole row at a time
+static c_texel_buffer resample_texels(const unsigned char* src, int width, int height, int dst_width, int dst_height) {
+    const c_resample_taps horizontal = build_resample_taps(width, dst_width);
+    const c_resample_taps vertical = build_resample_taps(height, dst_height);
+
+    const size_t row_floats = static_cast<size_t>(dst_width) * 4;
+    std::vector<float> rows(row_floats * height);
+    for (int y = 0; y < height; y++) {
+        const unsigned char* src_row = src + static_cast<size_t>(y) * width * 4;
+        float* dst_row = rows.data() + row_floats * y;
+        for (int x = 0; x < dst_width; x++) {
+            const int* indices = horizontal.indices.data() + static_cast<size_t>(x) * horizontal.stride;
+            const float* weights = horizontal.weights.data() + static_cast<size_t>(x) * horizontal.stride;
+            float accum[4] = {};
+            for (int k = 0; k < horizontal.stride; k++) {
+                const unsigned char* texel = src_row + indices[k] * 4;
+                for (int c = 0; c < 4; c++) {
+                    accum[c] += texel[c] * weights[k];
+                }
+            }
+            std::copy_n(accum, 4, dst_row + x * 4);
+        }
+    }
+
+    std::vector<unsigned char> result(row_floats * dst_height);
+    std::vector<float> accum(row_floats);
+    for (int y = 0; y < dst_height; y++) {
+        const int* indices = vertical.indices.data() + static_cast<size_t>(y) * vertical.stride;
+        const float* weights = vertical.weights.data() + static_cast<size_t>(y) * vertical.stride;
+        std::fill(accum.begin(), accum.end(), 0.0f);
+        for (int k = 0; k < vertical.stride; k++) {
+            const float* row = rows.data() + row_floats * indices[k];
+            const float weight = weights[k];
+            for (size_t i = 0; i < row_floats; i++) {
+                accum[i] += row[i] * weight;
+            }
+        }
+
+        // negative lobes can overshoot, clamped back into range
+        unsigned char* dst_row = result.data() + row_floats * y;
+        for (size_t i = 0; i < row_floats; i++) {
+            dst_row[i] = static_cast<unsigned char>(std::clamp(accum[i] + 0.5f, 0.0f, 255.0f));
+        }
+    }
+
+    return c_texel_buffer::from_vector(std::move(result));
+}
+
+void c_decoded_texture::downscale(int max_dimension) {
+    if (max_dimension <= 0 || pixels.empty() || layout != e_texel_layout::linear ||
+        (width <= max_dimension && height <= max_dimension)) {
+        return;
+    }
+
+    const float scale = static_cast<float>(max_dimension) / static_cast<float>(std::max(width, height));
+    const int dst_width = std::clamp(static_cast<int>(width * scale + 0.5f), 1, max_dimension);
+    const int dst_height = std::clamp(static_cast<int>(height * scale + 0.5f), 1, max_dimension);
+
+    pixels = resample_texels(pixels.data(), width, height, dst_width, dst_height);
+    width = dst_width;
+    height = dst_height;
+    mips.clear();
+    update_metrics();
+}
+
+// decode jobs use both, constructing them first keeps them alive until the destructor below has waited
+// for the last job
+c_texture_cache::c_texture_cache() {
+    c_job_system::get();
+    c_texture_disk_cache::get();
+}
+
+c_texture_cache::~c_texture_cache() {
+    running_.store(false, std::memory_order_release);
+    cancel_decodes(nullptr);
+    {
+        // queued jobs find nothing left to decode, an in-flight one is discarded at its next check
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        idle_cv_.wait(lock, [this] { return scheduled_decodes_ == 0; });
+    }
+
+    // the shared textures' deleters still touch the counters declared after these
+    staged_upgrades_.clear();
+    task_queue_ = {};
+    pending_.clear();
+    delete users_.exchange(nullptr);
+    retired_.clear();
+}
+
+void c_texture_cache::initialize(size_t memory_budget_mb) {
     if (running_.load(std::memory_order_acquire)) {
         return;
     }
 
+    memory_budget_.store((memory_budget_mb > 0 ? memory_budget_mb : max_memory_mb) * 1024 * 1024, std::memory_order_relaxed);
+
     running_.store(true, std::memory_order_release);
+}
+
+// the calling thread's reader slot, claimed by its first guard and given back when the thread exits
+struct c_reader_registration {
+    std::atomic<uint64_t>* epoch = nullptr;
+    std::atomic<uint64_t>* frame = nullptr;
+    std::atomic<bool>* claimed = nullptr;
+    int depth = 0;
 
-    if (worker_count <= 0) {
-        unsigned int hw_threads = std::thread::hardware_concurrency();
-        worker_count = (hw_threads > 4) ? 3 : ((hw_threads > 2) ? 2 : 1);
+    ~c_reader_registration() {
+        if (claimed) {
+            epoch->store(0, std::memory_order_release);
+            claimed->store(false, std::memory_order_release);
+        }
     }
+};
+
+static thread_local c_reader_registration reader_registration;
 
-    workers_.reserve(worker_count);
-    for (int i = 0; i < worker_count; ++i) {
-        workers_.emplace_back(&c_texture_cache::worker_thread, this, i);
+c_texture_read_guard::c_texture_read_guard() {
+    c_texture_cache::get().enter_read();
+}
+
+c_texture_read_guard::~c_texture_read_guard() {
+    c_texture_cache::get().exit_read();
+}
+
+// only the outermost guard of a thread publishes anything, and that is a plain store and a fence
+void c_texture_cache::enter_read() {
+    c_reader_registration& reader = reader_registration;
+    if (reader.depth++ > 0) {
+        return;
+    }
+
+    if (!reader.epoch) {
+        for (auto& slot : reader_slots_) {
+            bool expected = false;
+            if (!slot.claimed.load(std::memory_order_relaxed) &&
+                slot.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                reader.epoch = &slot.epoch;
+                reader.frame = &slot.frame;
+                reader.claimed = &slot.claimed;
+                break;
+            }
+        }
     }
 
+    if (reader.epoch) {
+        reader.frame->store(current_frame_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        reader.epoch->store(global_epoch_.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+    else {
+        unslotted_readers_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // pairs with the fence in reclaim, either reclaim sees this reader or the reader sees everything unlinked so far
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 }
 
-c_user_texture_cache* c_texture_cache::get_user_cache(const std::string& user_id) {
-    {
-        std::shared_lock<std::shared_mutex> read_lock(cache_mutex_);
-        auto it = cache_.find(user_id);
-        if (it != cache_.end()) {
-            return it->second.get();
+void c_texture_cache::exit_read() {
+    c_reader_registration& reader = reader_registration;
+    if (--reader.depth > 0) {
+        return;
+    }
+
+    if (reader.epoch) {
+        reader.epoch->store(0, std::memory_order_release);
+    }
+    else {
+        unslotted_readers_.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+// object has already been unlinked, readers that can still reach it entered at or before this epoch
+void c_texture_cache::retire(std::shared_ptr<const void> object) {
+    std::vector<c_retired_object> expired; // freed after the lock is released, the textures they drop retire too
+    std::lock_guard<std::mutex> lock(retire_mutex_);
+    retired_.push_back({global_epoch_.fetch_add(1, std::memory_order_seq_cst),
+                        current_frame_.load(std::memory_order_relaxed), std::move(object)});
+    reclaim(expired);
+}
+
+// retire_mutex_ held, moves what nobody can reach anymore to expired
+void c_texture_cache::reclaim(std::vector<c_retired_object>& expired) {
+    if (retired_.empty()) {
+        return;
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (unslotted_readers_.load(std::memory_order_acquire) > 0) {
+        return;
+    }
+
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (const auto& slot : reader_slots_) {
+        const uint64_t epoch = slot.epoch.load(std::memory_order_acquire);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+
+    const uint64_t frame = current_frame_.load(std::memory_order_relaxed);
+    auto kept = std::partition(retired_.begin(), retired_.end(), [oldest, frame](const c_retired_object& retired) {
+        return retired.epoch < oldest && retired.frame < frame;
+    });
+    std::move(retired_.begin(), kept, std::back_inserter(expired));
+    retired_.erase(retired_.begin(), kept);
+}
+
+// textures stamped at or after this are kept, the current frame's and those looked up under a guard still held
+uint64_t c_texture_cache::eviction_frame() const {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (unslotted_readers_.load(std::memory_order_acquire) > 0) {
+        return 0;
+    }
+
+    uint64_t frame = current_frame_.load(std::memory_order_relaxed);
+    for (const auto& slot : reader_slots_) {
+        if (slot.epoch.load(std::memory_order_acquire) != 0) {
+            frame = std::min(frame, slot.frame.load(std::memory_order_relaxed));
         }
     }
+    return frame;
+}
 
-    std::unique_lock<std::shared_mutex> write_lock(cache_mutex_);
-    auto& cache = cache_[user_id];
-    if (!cache) {
-        cache = std::make_unique<c_user_texture_cache>();
+const c_user_texture_table* c_texture_cache::find_user_table(const std::string& user_id) const {
+    const c_user_directory* users = users_.load(std::memory_order_acquire);
+    if (!users) {
+        return nullptr;
     }
-    return cache.get();
+
+    auto it = users->find(user_id);
+    return (it != users->end()) ? it->second->table.load(std::memory_order_acquire) : nullptr;
 }
 
-void c_texture_cache::request_texture(const std::string& user_id, int texture_index,
-                                      const std::vector<unsigned char>& data, bool high_priority) {
-    if (data.empty() || user_id.empty()) {
+// eviction clears ready before it reads the stamp and this stamps before it reads ready again, with a fence on
+// both sides one of them always sees the other, so a texture handed out here is never evicted this frame.
+// an evicted texture is queued for decoding again by the first lookup that finds it
+c_decoded_texture* c_texture_cache::use_texture(const std::string& user_id, const std::shared_ptr<c_decoded_texture>& texture,
+                                                int priority) {
+    if (!texture) {
+        return nullptr;
+    }
+    if (!texture->ready.load(std::memory_order_acquire)) {
+        if (texture->evicted.load(std::memory_order_relaxed)) {
+            reload_texture(user_id, texture, priority);
+        }
+        return nullptr;
+    }
+
+    // stamped earlier this frame, behind the same fence, nothing left to publish
+    const uint64_t frame = current_frame_.load(std::memory_order_relaxed);
+    if (texture->last_used_frame.load(std::memory_order_relaxed) == frame) {
+        return texture.get();
+    }
+
+    texture->last_used_frame.store(frame, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return texture->ready.load(std::memory_order_acquire) ? texture.get() : nullptr;
+}
+
+// a decode for an evicted texture on behalf of the user that looked it up, from the bytes it was created with.
+// persistent textures are usually mapped straight back from the disk tier
+void c_texture_cache::reload_texture(const std::string& user_id, const std::shared_ptr<c_decoded_texture>& texture, int priority) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (!texture->evicted.exchange(false, std::memory_order_relaxed) || texture->ready.load(std::memory_order_acquire) ||
+        !texture->encoded || !running_.load(std::memory_order_acquire)) {
         return;
     }
 
-    auto* user_cache = get_user_cache(user_id);
-    if (user_cache) {
-        std::shared_lock<std::shared_mutex> lock(user_cache->mutex);
-        auto it = user_cache->textures.find(texture_index);
-        if (it != user_cache->textures.end()) {
-            if (it->second->ready.load(std::memory_order_acquire) ||
-                it->second->decoding.load(std::memory_order_acquire)) {
-                return;
-            }
+    auto [it, inserted] = pending_.try_emplace(texture->content_key);
+    c_pending_decode& pending = it->second;
+    pending.users.insert(user_id);
+    if (!inserted) {
+        return;
+    }
+
+    pending.texture = texture;
+    pending.data = texture->encoded;
+    pending.priority = priority;
+    pending.max_dimension = texture->max_dimension;
+    texture->decoding.store(true, std::memory_order_release);
+    pending.sequence = ++next_sequence_;
+    schedule_decode(it->first, pending);
+}
+
+// cache_mutex_ held
+c_user_texture_cache& c_texture_cache::get_user_cache(const std::string& user_id) {
+    const c_user_directory* users = users_.load(std::memory_order_relaxed);
+    if (users) {
+        auto it = users->find(user_id);
+        if (it != users->end()) {
+            return *it->second;
         }
     }
 
-    decode_task task;
-    task.user_id = user_id;
-    task.texture_index = texture_index;
-    task.data = data;
-    task.is_face = false;
-    task.priority = high_priority ? priority_high : priority_normal;
+    auto updated = users ? std::make_unique<c_user_directory>(*users) : std::make_unique<c_user_directory>();
+    auto cache = std::make_shared<c_user_texture_cache>();
+    updated->emplace(user_id, cache);
+    publish_users(std::move(updated));
+    return *cache;
+}
 
-    {
-        std::lock_guard<std::mutex> lock(queue_mutex_);
-        task_queue_.push(std::move(task));
+// cache_mutex_ held
+void c_texture_cache::publish_users(std::unique_ptr<c_user_directory> users) {
+    const c_user_directory* previous = users_.exchange(users.release(), std::memory_order_seq_cst);
+    if (previous) {
+        retire(std::shared_ptr<const c_user_directory>(previous));
+    }
+}
+
+// cache_mutex_ held
+void c_texture_cache::publish_user_table(c_user_texture_cache& user_cache, std::unique_ptr<c_user_texture_table> table) {
+    const c_user_texture_table* previous = user_cache.table.exchange(table.release(), std::memory_order_seq_cst);
+    if (previous) {
+        retire(std::shared_ptr<const c_user_texture_table>(previous));
     }
+}
 
-    queue_cv_.notify_one();
+void c_texture_cache::request_texture(const std::string& user_id, int texture_index,
+                                      const std::vector<unsigned char>& data, bool high_priority) {
+    request_texture(user_id, texture_index, std::make_shared<const std::vector<unsigned char>>(data), high_priority);
 }
 
 void c_texture_cache::request_face_texture(const std::string& user_id,
                                            const std::vector<unsigned char>& data) {
-    if (data.empty() || user_id.empty()) {
+    request_face_texture(user_id, std::make_shared<const std::vector<unsigned char>>(data));
+}
+
+void c_texture_cache::request_texture(const std::string& user_id, int texture_index,
+                                      c_encoded_data data, bool high_priority, const std::string& content_hash,
+                                      int max_dimension) {
+    request_shared(user_id, texture_index, std::move(data), high_priority ? priority_high : priority_normal,
+                   content_hash, max_dimension);
+}
+
+void c_texture_cache::request_face_texture(const std::string& user_id, c_encoded_data data, const std::string& content_hash,
+                                           int max_dimension) {
+    request_shared(user_id, -1, std::move(data), priority_face, content_hash, max_dimension);
+}
+
+// without a cdn hash only requests passing the same buffer share a texture. the texture holds on to the buffer,
+// so its address can't be reused by other bytes while the key is live. prefixed so it never matches a cdn hash
+static std::string make_content_key(const std::string& content_hash, const c_encoded_data& data) {
+    if (!content_hash.empty()) {
+        return content_hash;
+    }
+    return "#" + std::to_string(reinterpret_cast<uintptr_t>(data.get()));
+}
+
+// texture_index -1 is the face texture
+void c_texture_cache::request_shared(const std::string& user_id, int texture_index, c_encoded_data data,
+                                     int priority, const std::string& content_hash, int max_dimension) {
+    if (!data || data->empty() || user_id.empty()) {
         return;
     }
 
-    auto* user_cache = get_user_cache(user_id);
-    if (user_cache) {
-        std::shared_lock<std::shared_mutex> lock(user_cache->mutex);
-        if (user_cache->face_texture->ready.load(std::memory_order_acquire) ||
-            user_cache->face_texture->decoding.load(std::memory_order_acquire)) {
-            return;
+    if (max_dimension <= 0) {
+        max_dimension = max_texture_size_.load(std::memory_order_relaxed);
+    }
+
+    const std::string content_key = make_content_key(content_hash, data);
+    std::shared_ptr<c_decoded_texture> texture;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        c_user_texture_cache& user_cache = get_user_cache(user_id);
+        const c_user_texture_table* table = user_cache.table.load(std::memory_order_relaxed);
+        if (table) {
+            if (texture_index < 0) {
+                texture = table->face_texture;
+            }
+            else {
+                auto it = table->textures.find(texture_index);
+                if (it != table->textures.end()) {
+                    texture = it->second;
+                }
+            }
+        }
+
+        if (!texture || texture->content_key != content_key) {
+            texture = acquire_shared_texture(content_key, data);
+            auto updated = table ? std::make_unique<c_user_texture_table>(*table) : std::make_unique<c_user_texture_table>();
+            if (texture_index < 0) {
+                updated->face_texture = texture;
+            }
+            else {
+                updated->textures[texture_index] = texture;
+            }
+            publish_user_table(user_cache, std::move(updated));
         }
     }
 
-    decode_task task;
-    task.user_id = user_id;
-    task.texture_index = -1;
-    task.data = data;
-    task.is_face = true;
-    task.priority = priority_face;
+    // a preview still counts as missing, this user has to keep its upgrade alive too
+    if (texture->ready.load(std::memory_order_acquire) && !texture->preview.load(std::memory_order_acquire)) {
+        memory_hit_count_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
 
     {
         std::lock_guard<std::mutex> lock(queue_mutex_);
-        task_queue_.push(std::move(task));
+        // re-checked under the lock, workers publish before they retire the pending decode
+        const bool ready = texture->ready.load(std::memory_order_acquire);
+        if (ready && !texture->preview.load(std::memory_order_acquire)) {
+            memory_hit_count_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto [it, inserted] = pending_.try_emplace(content_key);
+        c_pending_decode& pending = it->second;
+        pending.users.insert(user_id);
+        if (inserted) {
+            pending.texture = std::move(texture);
+            pending.data = std::move(data);
+            pending.priority = priority;
+            pending.max_dimension = max_dimension;
+            pending.upgrade = ready; // a preview whose upgrade was cancelled
+            pending.texture->decoding.store(true, std::memory_order_release);
+            pending.texture->max_dimension = max_dimension;
+        }
+        else if (pending.in_flight) {
+            pending.cancelled = false;
+            return;
+        }
+        else {
+            // shared by everyone asking, so the least restrictive size wins
+            pending.max_dimension = (pending.max_dimension > 0 && max_dimension > 0) ? std::max(pending.max_dimension, max_dimension) : 0;
+            pending.texture->max_dimension = pending.max_dimension;
+            if (priority <= pending.priority) {
+                return;
+            }
+            pending.priority = priority;
+        }
+
+        pending.sequence = ++next_sequence_;
+        schedule_decode(content_key, pending);
     }
+}
 
-    queue_cv_.notify_one();
+// coverage is read when the task is queued, a change in it re-queues the decode (see update_coverage)
+c_texture_cache::decode_task c_texture_cache::make_task(const std::string& content_key, const c_pending_decode& pending) const {
+    return {content_key, pending.priority + pending.texture->coverage_priority.load(std::memory_order_relaxed),
+            pending.sequence, pending.upgrade};
 }
 
-void c_texture_cache::worker_thread(int worker_id) {
-    while (running_.load(std::memory_order_acquire)) {
-        decode_task task;
-        bool has_task = false;
+void c_texture_cache::report_coverage(const std::string& user_id, int texture_index, float pixels) {
+    c_texture_read_guard guard;
+    const c_user_texture_table* table = find_user_table(user_id);
+    if (!table) {
+        return;
+    }
 
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex_);
-            queue_cv_.wait(lock, [this] {
-                return !task_queue_.empty() || !running_.load(std::memory_order_acquire);
-            });
+    auto it = table->textures.find(texture_index);
+    if (it != table->textures.end()) {
+        update_coverage(*it->second, pixels);
+    }
+}
 
-            if (!running_.load(std::memory_order_acquire) && task_queue_.empty()) {
-                break;
-            }
+void c_texture_cache::report_face_coverage(const std::string& user_id, float pixels) {
+    c_texture_read_guard guard;
+    const c_user_texture_table* table = find_user_table(user_id);
+    if (table && table->face_texture) {
+        update_coverage(*table->face_texture, pixels);
+    }
+}
 
-            if (!task_queue_.empty()) {
-                task = std::move(const_cast<decode_task&>(task_queue_.top()));
-                task_queue_.pop();
-                has_task = true;
-            }
+// every 4x the screen area is one step, a texture filling the view outranks any request priority
+int c_texture_cache::coverage_priority(float pixels) {
+    int priority = 0;
+    for (float area = 4.0f; area <= pixels && priority < max_coverage_priority; area *= 4.0f) {
+        priority += priority_coverage_step;
+    }
+    return priority;
+}
+
+// only a texture still waiting for a worker is touched, and only when its coverage moved to another step,
+// so a steady frame reports without taking any lock
+void c_texture_cache::update_coverage(c_decoded_texture& texture, float pixels) {
+    const int priority = coverage_priority(pixels);
+    if (texture.coverage_priority.load(std::memory_order_relaxed) == priority) {
+        return;
+    }
+    texture.coverage_priority.store(priority, std::memory_order_relaxed);
+    if (!texture.decoding.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    auto it = pending_.find(texture.content_key);
+    if (it == pending_.end() || it->second.in_flight || it->second.texture.get() != &texture) {
+        return;
+    }
+    it->second.sequence = ++next_sequence_;
+    schedule_decode(it->first, it->second);
+}
+
+// memory is accounted per texture, not per user, and handed back with the last reference
+std::shared_ptr<c_decoded_texture> c_texture_cache::create_texture(const std::string& content_key) {
+    std::shared_ptr<c_decoded_texture> texture(new c_decoded_texture(), [this](c_decoded_texture* texture) {
+        total_memory_usage_.fetch_sub(texture->memory_size(), std::memory_order_relaxed);
+        // the last reference can go on any thread mid-frame, unguarded readers may still be drawing it
+        if (running_.load(std::memory_order_acquire)) {
+            retire(std::shared_ptr<const c_decoded_texture>(texture));
+        }
+        else {
+            delete texture;
+        }
+    });
+    texture->content_key = content_key;
+    return texture;
+}
+
+std::shared_ptr<c_decoded_texture> c_texture_cache::acquire_shared_texture(const std::string& content_key, const c_encoded_data& data) {
+    std::lock_guard<std::mutex> lock(shared_mutex_);
+    auto& slot = shared_textures_[content_key];
+    if (auto texture = slot.lock()) {
+        shared_hit_count_.fetch_add(1, std::memory_order_relaxed);
+        return texture;
+    }
+
+    auto texture = create_texture(content_key);
+    texture->encoded = data;
+    slot = texture;
+    return texture;
+}
+
+void c_texture_cache::prune_shared_textures() {
+    std::lock_guard<std::mutex> lock(shared_mutex_);
+    for (auto it = shared_textures_.begin(); it != shared_textures_.end();) {
+        if (it->second.expired()) {
+            it = shared_textures_.erase(it);
+        }
+        else {
+            ++it;
         }
+    }
+}
 
-        if (has_task) {
-            active_workers_.fetch_add(1, std::memory_order_relaxed);
+// queue_mutex_ must be held. every task_queue_ entry comes with one job, which decodes whatever is on top of
+// the queue when it runs, so priority and coverage changes still reorder decodes that are already submitted
+void c_texture_cache::schedule_decode(const std::string& content_key, const c_pending_decode& pending) {
+    const decode_task task = make_task(content_key, pending);
+    const e_job_priority priority = task.upgrade ? e_job_priority::low
+        : (task.priority >= priority_high ? e_job_priority::high : e_job_priority::normal);
+    task_queue_.push(task);
+    scheduled_decodes_++;
+    c_job_system::get().submit([this] { run_decode(); }, priority);
+}
 
-            bool success = false;
-            if (task.is_face) {
-                success = decode_face_texture(task.user_id, task.data);
-            } else {
-                success = decode_texture(task.user_id, task.texture_index, task.data);
+void c_texture_cache::run_decode() {
+    decode_task task;
+    std::shared_ptr<c_decoded_texture> texture;
+    c_encoded_data data;
+    c_decoded_image source;
+    int max_dimension = 0;
+    bool upgrade = false;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        for (;;) {
+            // the entries this job was submitted for were superseded and served by earlier jobs
+            if (task_queue_.empty()) {
+                scheduled_decodes_--;
+                idle_cv_.notify_all();
+                return;
             }
 
-            active_workers_.fetch_sub(1, std::memory_order_relaxed);
+            task = std::move(const_cast<decode_task&>(task_queue_.top()));
+            task_queue_.pop();
 
-            if (!success) {
-                // fuck you skids, -- nova (failed)
+            // superseded by a priority or coverage change, or cancelled before it started
+            auto it = pending_.find(task.content_key);
+            if (it == pending_.end() || it->second.sequence != task.sequence || it->second.in_flight) {
+                continue;
             }
+
+            it->second.in_flight = true;
+            texture = it->second.texture;
+            data = it->second.data;
+            max_dimension = it->second.max_dimension;
+            upgrade = it->second.upgrade;
+            source = std::move(it->second.source);
+            break;
         }
     }
-}
 
-bool c_texture_cache::decode_texture(const std::string& user_id, int texture_index,
-                                     const std::vector<unsigned char>& data) {
-    auto* user_cache = get_user_cache(user_id);
-    if (!user_cache) {
-        return false;
-    }
+    active_workers_.fetch_add(1, std::memory_order_relaxed);
+
+    // the pending decode is retired under the same lock that decides cancellation, so a request
+    // racing with it either revives the decode or finds nothing pending and queues a new one
+    const std::string& content_key = task.content_key;
+    auto cancelled = [this, &content_key] {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        auto it = pending_.find(content_key);
+        if (it == pending_.end() || !it->second.cancelled) {
+            return false;
+        }
+        it->second.texture->decoding.store(false, std::memory_order_release);
+        pending_.erase(it);
+        return true;
+    };
+    bool success = upgrade ? upgrade_texture(texture, *data, std::move(source), max_dimension, cancelled)
+                           : decode_pixels(*texture, *data, max_dimension, cancelled, source);
+
+    active_workers_.fetch_sub(1, std::memory_order_relaxed);
 
-    c_decoded_texture* texture = nullptr;
     {
-        std::unique_lock<std::shared_mutex> lock(user_cache->mutex);
-        auto it = user_cache->textures.find(texture_index);
-        if (it == user_cache->textures.end()) {
-            auto new_texture = std::make_unique<c_decoded_texture>();
-            texture = new_texture.get();
-            user_cache->textures[texture_index] = std::move(new_texture);
-        } else {
-            texture = it->second.get();
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        auto it = pending_.find(content_key);
+        if (it != pending_.end() && it->second.in_flight) {
+            c_pending_decode& pending = it->second;
+            if (success && upgrade) {
+                // staged, apply_upgrades retires the pending decode once the levels are swapped in
+            }
+            else if (success && pending.texture->preview.load(std::memory_order_relaxed) && !pending.cancelled) {
+                // a preview went up, its full quality version waits behind every first decode
+                pending.in_flight = false;
+                pending.upgrade = true;
+                pending.source = std::move(source);
+                pending.sequence = ++next_sequence_;
+                schedule_decode(content_key, pending);
+            }
+            else {
+                pending.texture->decoding.store(false, std::memory_order_release);
+                pending_.erase(it);
+            }
         }
+        texture.reset(); // may be the last reference, dropped before the destructor can stop waiting
+        scheduled_decodes_--;
+        idle_cv_.notify_all();
     }
 
-    if (!texture) {
-        return false;
+    if (!success) {
+        // fuck you skids, -- nova (failed)
     }
+}
 
-    texture->decoding.store(true, std::memory_order_release);
+// user_id nullptr cancels everything
+void c_texture_cache::cancel_decodes(const std::string* user_id) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        c_pending_decode& pending = it->second;
+        if (user_id) {
+            pending.users.erase(*user_id);
+        }
+        else {
+            pending.users.clear();
+        }
+
+        if (!pending.users.empty()) {
+            ++it;
+        }
+        else if (pending.in_flight) {
+            pending.cancelled = true;
+            ++it;
+        }
+        else {
+            pending.texture->decoding.store(false, std::memory_order_release);
+            it = pending_.erase(it);
+        }
+    }
+}
+
+static bool decode_image(const std::vector<unsigned char>& data, c_decoded_image& image) {
     int width = 0, height = 0, channels = 0;
     unsigned char* pixels = stbi_load_from_memory(
         data.data(),
@@ -193,129 +1043,454 @@ bool c_texture_cache::decode_texture(const std::string& user_id, int texture_ind
         if (pixels) {
             stbi_image_free(pixels);
         }
-        texture->decoding.store(false, std::memory_order_release);
         return false;
     }
-    size_t pixel_count = width * height * 4;
-    texture->pixels.resize(pixel_count);
-    std::memcpy(texture->pixels.data(), pixels, pixel_count);
-    stbi_image_free(pixels);
-    texture->width = width;
-    texture->height = height;
-    texture->channels = 4;
-    texture->update_metrics();
-    texture->decoding.store(false, std::memory_order_release);
-    texture->ready.store(true, std::memory_order_release);
-    user_cache->memory_usage.fetch_add(pixel_count, std::memory_order_relaxed);
-    total_memory_usage_.fetch_add(pixel_count, std::memory_order_relaxed);
 
+    // the decoder's allocation becomes the texture storage, freed by stbi_image_free with the last reference
+    size_t pixel_count = static_cast<size_t>(width) * height * 4;
+    image.pixels = c_texel_buffer(pixels, pixel_count, std::shared_ptr<void>(pixels, [](void* p) { stbi_image_free(p); }));
+    image.width = width;
+    image.height = height;
     return true;
 }
 
-bool c_texture_cache::decode_face_texture(const std::string& user_id,
-                                          const std::vector<unsigned char>& data) {
-    auto* user_cache = get_user_cache(user_id);
-    if (!user_cache || !user_cache->face_texture) {
+static void adopt_image(c_decoded_texture& texture, c_texel_buffer pixels, int width, int height,
+                        const c_decoded_image& image) {
+    texture.pixels = std::move(pixels);
+    texture.width = width;
+    texture.height = height;
+    texture.source_width = image.width;
+    texture.source_height = image.height;
+    texture.channels = 4;
+    texture.update_metrics();
+    texture.layout = e_texel_layout::linear;
+    texture.format = e_texel_format::rgba8;
+    texture.palette.reset();
+}
+
+// full quality levels: downscaled to the cap, mipped, then compressed or tiled
+static void build_texture(c_decoded_texture& texture, const c_decoded_image& image, const c_texture_decode_settings& settings) {
+    adopt_image(texture, image.pixels, image.width, image.height, image);
+    texture.downscale(settings.max_dimension);
+    texture.build_mips();
+    if (!texture.compress(settings.compression) && settings.layout == e_texel_layout::tiled) {
+        texture.convert_to_tiled();
+    }
+}
+
+// box-filtered stand-in no larger than max_dimension, one pass over the image and nothing else
+static void build_preview(c_decoded_texture& texture, const c_decoded_image& image, int max_dimension) {
+    const int step = (std::max(image.width, image.height) + max_dimension - 1) / max_dimension;
+    const int width = (image.width + step - 1) / step;
+    const int height = (image.height + step - 1) / step;
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 4);
+
+    for (int y = 0; y < height; y++) {
+        const int y0 = y * step;
+        const int y1 = std::min(y0 + step, image.height);
+        for (int x = 0; x < width; x++) {
+            const int x0 = x * step;
+            const int x1 = std::min(x0 + step, image.width);
+            uint32_t sum[4] = {0, 0, 0, 0};
+            for (int sy = y0; sy < y1; sy++) {
+                const unsigned char* row = image.pixels.data() + (static_cast<size_t>(sy) * image.width + x0) * 4;
+                for (int sx = x0; sx < x1; sx++, row += 4) {
+                    sum[0] += row[0];
+                    sum[1] += row[1];
+                    sum[2] += row[2];
+                    sum[3] += row[3];
+                }
+            }
+            const uint32_t count = static_cast<uint32_t>((y1 - y0) * (x1 - x0));
+            unsigned char* dst = pixels.data() + (static_cast<size_t>(y) * width + x) * 4;
+            for (int c = 0; c < 4; c++) {
+                dst[c] = static_cast<unsigned char>((sum[c] + count / 2) / count);
+            }
+        }
+    }
+
+    adopt_image(texture, c_texel_buffer::from_vector(std::move(pixels)), width, height, image);
+    texture.build_mips();
+}
+
+c_texture_decode_settings c_texture_cache::decode_settings(int max_dimension) const {
+    c_texture_decode_settings settings;
+    settings.max_dimension = max_dimension;
+    settings.compression = texture_compression_.load(std::memory_order_relaxed);
+    settings.layout = texel_layout_.load(std::memory_order_relaxed);
+    return settings;
+}
+
+// buffer keys only mean something inside this process, cdn hashes are persisted
+static bool is_persistent(const std::string& content_key) {
+    return !content_key.empty() && content_key[0] != '#';
+}
+
+// decoding is set and cleared by the pending decode, cancelled is asked once the image is decoded so a
+// cancelled texture skips its mips and is never published. the disk tier is tried before the decoder.
+// large images are published as a preview, source then keeps the decoded image for the upgrade
+bool c_texture_cache::decode_pixels(c_decoded_texture& texture, const std::vector<unsigned char>& data, int max_dimension,
+                                    const std::function<bool()>& cancelled, c_decoded_image& source) {
+    auto& disk_cache = c_texture_disk_cache::get();
+    const c_texture_decode_settings settings = decode_settings(max_dimension);
+    const bool persistent = is_persistent(texture.content_key);
+    texture.preview.store(false, std::memory_order_relaxed);
+
+    if (persistent && disk_cache.load(texture.content_key, settings, texture)) {
+        if (cancelled()) {
+            texture.release_levels();
+            return false;
+        }
+        disk_hit_count_.fetch_add(1, std::memory_order_relaxed);
+        publish_texture(texture);
+        return true;
+    }
+
+    c_decoded_image image;
+    if (!decode_image(data, image) || cancelled()) {
         return false;
     }
+    decode_count_.fetch_add(1, std::memory_order_relaxed);
 
-    auto& texture = user_cache->face_texture;
-    texture->decoding.store(true, std::memory_order_release);
-    int width = 0, height = 0, channels = 0;
-    unsigned char* pixels = stbi_load_from_memory(
-        data.data(),
-        static_cast<int>(data.size()),
-        &width, &height, &channels, 4
-    );
+    if (progressive_decode_.load(std::memory_order_relaxed) &&
+        std::max(image.width, image.height) > preview_dimension * 2) {
+        build_preview(texture, image, preview_dimension);
+        texture.preview.store(true, std::memory_order_relaxed);
+        publish_texture(texture);
+        source = std::move(image);
+        return true;
+    }
 
-    if (!pixels || width <= 0 || height <= 0) {
-        if (pixels) {
-            stbi_image_free(pixels);
+    build_texture(texture, image, settings);
+    publish_texture(texture);
+
+    // written after publishing, eviction leaves the texture alone until its pending decode is retired
+    if (persistent) {
+        disk_cache.store(texture.content_key, settings, texture);
+    }
+    return true;
+}
+
+// the full quality levels are built next to the preview and staged, begin_frame swaps them in. the texture
+// itself never changes, so a pointer handed out for this frame stays valid whether or not a guard is held
+bool c_texture_cache::upgrade_texture(const std::shared_ptr<c_decoded_texture>& preview, const std::vector<unsigned char>& data,
+                                      c_decoded_image source, int max_dimension, const std::function<bool()>& cancelled) {
+    auto& disk_cache = c_texture_disk_cache::get();
+    const c_texture_decode_settings settings = decode_settings(max_dimension);
+    const bool persistent = is_persistent(preview->content_key);
+
+    auto levels = std::make_unique<c_decoded_texture>();
+    const bool from_disk = persistent && disk_cache.load(preview->content_key, settings, *levels);
+    if (from_disk) {
+        disk_hit_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        if (source.pixels.empty()) {
+            if (!decode_image(data, source)) {
+                return false;
+            }
+            decode_count_.fetch_add(1, std::memory_order_relaxed);
         }
-        texture->decoding.store(false, std::memory_order_release);
+        build_texture(*levels, source, settings);
+        source.pixels.reset();
+    }
+
+    if (cancelled()) {
         return false;
     }
-    size_t pixel_count = width * height * 4;
-    texture->pixels.resize(pixel_count);
-    std::memcpy(texture->pixels.data(), pixels, pixel_count);
-    stbi_image_free(pixels);
-    texture->width = width;
-    texture->height = height;
-    texture->channels = 4;
-    texture->update_metrics();
-    texture->decoding.store(false, std::memory_order_release);
-    texture->ready.store(true, std::memory_order_release);
-    user_cache->memory_usage.fetch_add(pixel_count, std::memory_order_relaxed);
-    total_memory_usage_.fetch_add(pixel_count, std::memory_order_relaxed);
 
+    if (!from_disk && persistent) {
+        disk_cache.store(preview->content_key, settings, *levels);
+    }
+
+    std::lock_guard<std::mutex> lock(upgrade_mutex_);
+    staged_upgrades_.push_back({preview, std::move(levels)});
     return true;
 }
 
-c_decoded_texture* c_texture_cache::get_texture(const std::string& user_id, int texture_index) {
-    std::shared_lock<std::shared_mutex> cache_lock(cache_mutex_);
-    auto it = cache_.find(user_id);
-    if (it == cache_.end()) {
-        return nullptr;
+// eviction's handshake with use_texture: ready is cleared before the stamp is re-read, so the levels only
+// change once nobody has looked the texture up since frame began. false leaves the texture untouched
+bool c_texture_cache::swap_levels(c_decoded_texture& texture, c_decoded_texture& levels, uint64_t frame) {
+    if (texture.last_used_frame.load(std::memory_order_relaxed) >= frame) {
+        return false;
+    }
+
+    texture.ready.store(false, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (texture.last_used_frame.load(std::memory_order_relaxed) >= frame) {
+        texture.ready.store(true, std::memory_order_release);
+        return false;
     }
 
-    auto* user_cache = it->second.get();
-    std::shared_lock<std::shared_mutex> user_lock(user_cache->mutex);
+    const size_t previous_size = texture.memory_size();
+    texture.pixels = std::move(levels.pixels);
+    texture.width = levels.width;
+    texture.height = levels.height;
+    texture.source_width = levels.source_width;
+    texture.source_height = levels.source_height;
+    texture.channels = levels.channels;
+    texture.mips = std::move(levels.mips);
+    texture.layout = levels.layout;
+    texture.format = levels.format;
+    texture.palette = std::move(levels.palette);
+    texture.update_metrics();
+    texture.preview.store(false, std::memory_order_relaxed);
 
-    auto tex_it = user_cache->textures.find(texture_index);
-    if (tex_it != user_cache->textures.end()) {
-        bool ready = tex_it->second->ready.load(std::memory_order_acquire);
-        bool decoding = tex_it->second->decoding.load(std::memory_order_acquire);
-        if (ready) {
-            return tex_it->second.get();
+    total_memory_usage_.fetch_add(texture.memory_size(), std::memory_order_relaxed);
+    total_memory_usage_.fetch_sub(previous_size, std::memory_order_relaxed);
+    texture.ready.store(true, std::memory_order_release);
+    return true;
+}
+
+// runs at the start of a frame, a preview still drawn by a guard from an earlier frame waits for the next one
+void c_texture_cache::apply_upgrades() {
+    std::vector<c_staged_upgrade> staged;
+    {
+        std::lock_guard<std::mutex> lock(upgrade_mutex_);
+        if (staged_upgrades_.empty()) {
+            return;
         }
+        staged.swap(staged_upgrades_);
     }
 
-    return nullptr;
-}
+    const uint64_t frame = eviction_frame();
+    std::vector<c_staged_upgrade> deferred;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        for (auto& upgrade : staged) {
+            c_decoded_texture& texture = *upgrade.texture;
+            auto it = pending_.find(texture.content_key);
+            if (it == pending_.end() || it->second.texture != upgrade.texture) {
+                continue;
+            }
 
-c_decoded_texture* c_texture_cache::get_face_texture(const std::string& user_id) {
-    std::shared_lock<std::shared_mutex> cache_lock(cache_mutex_);
-    auto it = cache_.find(user_id);
-    if (it == cache_.end()) {
-        return nullptr;
+            // nobody is left waiting for it, the preview stays until someone asks again
+            if (!it->second.cancelled && !swap_levels(texture, *upgrade.levels, frame)) {
+                deferred.push_back(std::move(upgrade));
+                continue;
+            }
+            texture.decoding.store(false, std::memory_order_release);
+            pending_.erase(it);
+        }
+    }
+
+    if (!deferred.empty()) {
+        std::lock_guard<std::mutex> lock(upgrade_mutex_);
+        std::move(deferred.begin(), deferred.end(), std::back_inserter(staged_upgrades_));
     }
+    enforce_budget();
+}
 
-    auto* user_cache = it->second.get();
-    std::shared_lock<std::shared_mutex> user_lock(user_cache->mutex);
+void c_texture_cache::publish_texture(c_decoded_texture& texture) {
+    // counted before ready so an eviction can never subtract it first
+    total_memory_usage_.fetch_add(texture.memory_size(), std::memory_order_relaxed);
+    texture.last_used_frame.store(current_frame_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    texture.ready.store(true, std::memory_order_release);
+    enforce_budget();
+}
 
-    if (user_cache->face_texture &&
-        user_cache->face_texture->ready.load(std::memory_order_acquire)) {
-        return user_cache->face_texture.get();
+c_decoded_texture* c_texture_cache::get_texture(const std::string& user_id, int texture_index) {
+    c_texture_read_guard guard;
+    const c_user_texture_table* table = find_user_table(user_id);
+    if (!table) {
+        return nullptr;
     }
 
-    return nullptr;
+    auto it = table->textures.find(texture_index);
+    return (it != table->textures.end()) ? use_texture(user_id, it->second, priority_normal) : nullptr;
 }
 
+c_decoded_texture* c_texture_cache::get_face_texture(const std::string& user_id) {
+    c_texture_read_guard guard;
+    const c_user_texture_table* table = find_user_table(user_id);
+    return table ? use_texture(user_id, table->face_texture, priority_face) : nullptr;
+}
+
+// the user's table and textures are retired with the directory, readers still pinning them keep them alive
 void c_texture_cache::clear_user(const std::string& user_id) {
-    std::unique_lock<std::shared_mutex> lock(cache_mutex_);
-    auto it = cache_.find(user_id);
-    if (it != cache_.end()) {
-        size_t user_memory = it->second->memory_usage.load(std::memory_order_relaxed);
-        total_memory_usage_.fetch_sub(user_memory, std::memory_order_relaxed);
-        cache_.erase(it);
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        const c_user_directory* users = users_.load(std::memory_order_relaxed);
+        if (users && users->count(user_id)) {
+            auto updated = std::make_unique<c_user_directory>(*users);
+            updated->erase(user_id);
+            publish_users(std::move(updated));
+        }
     }
+    cancel_decodes(&user_id);
+    prune_shared_textures();
 }
 
+// in-flight decodes keep their textures until the worker drops them, their memory is returned then
 void c_texture_cache::clear_all() {
-    std::unique_lock<std::shared_mutex> lock(cache_mutex_);
-    cache_.clear();
-    total_memory_usage_.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        publish_users(nullptr);
+    }
+    cancel_decodes(nullptr);
+    prune_shared_textures();
 }
 
 size_t c_texture_cache::get_memory_usage() const {
     return total_memory_usage_.load(std::memory_order_relaxed);
 }
 
+size_t c_texture_cache::get_memory_budget() const {
+    return memory_budget_.load(std::memory_order_relaxed);
+}
+
+size_t c_texture_cache::get_eviction_count() const {
+    return eviction_count_.load(std::memory_order_relaxed);
+}
+
+size_t c_texture_cache::get_evicted_bytes() const {
+    return evicted_bytes_.load(std::memory_order_relaxed);
+}
+
+size_t c_texture_cache::get_shared_hit_count() const {
+    return shared_hit_count_.load(std::memory_order_relaxed);
+}
+
+size_t c_texture_cache::get_memory_hit_count() const {
+    return memory_hit_count_.load(std::memory_order_relaxed);
+}
+
+size_t c_texture_cache::get_disk_hit_count() const {
+    return disk_hit_count_.load(std::memory_order_relaxed);
+}
+
+size_t c_texture_cache::get_decode_count() const {
+    return decode_count_.load(std::memory_order_relaxed);
+}
+
+void c_texture_cache::begin_frame() {
+    current_frame_.fetch_add(1, std::memory_order_relaxed);
+    apply_upgrades();
+
+    std::vector<c_retired_object> expired;
+    std::unique_lock<std::mutex> lock(retire_mutex_, std::try_to_lock);
+    if (lock.owns_lock()) {
+        reclaim(expired);
+    }
+}
+
+// drops the pixels but keeps the shared texture and its encoded bytes, the next lookup decodes it again
+// (see reload_texture)
+bool c_texture_cache::evict_texture(const std::shared_ptr<c_decoded_texture>& texture, uint64_t frame) {
+    // request_shared re-checks ready under this lock, so it never queues a decode for a texture that only
+    // looks evicted while the stamp is re-read below
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (!texture->ready.load(std::memory_order_acquire) ||
+        texture->decoding.load(std::memory_order_acquire) ||
+        texture->last_used_frame.load(std::memory_order_relaxed) >= frame) {
+        return false;
+    }
+
+    // see use_texture
+    texture->ready.store(false, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (texture->last_used_frame.load(std::memory_order_relaxed) >= frame) {
+        texture->ready.store(true, std::memory_order_release);
+        return false;
+    }
+
+    size_t bytes = texture->memory_size();
+    texture->release_levels();
+    texture->preview.store(false, std::memory_order_relaxed);
+    texture->evicted.store(true, std::memory_order_relaxed);
+
+    total_memory_usage_.fetch_sub(bytes, std::memory_order_relaxed);
+    eviction_count_.fetch_add(1, std::memory_order_relaxed);
+    evicted_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    return true;
+}
+
+// least recently used textures go first, anything stamped in the current frame is kept even over budget
+void c_texture_cache::enforce_budget() {
+    if (total_memory_usage_.load(std::memory_order_relaxed) <= memory_budget_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> eviction_lock(eviction_mutex_, std::try_to_lock);
+    if (!eviction_lock.owns_lock()) {
+        return;
+    }
+
+    struct c_eviction_candidate {
+        uint64_t last_used_frame;
+        std::shared_ptr<c_decoded_texture> texture;
+    };
+
+    const uint64_t frame = eviction_frame();
+    std::vector<c_eviction_candidate> candidates;
+    {
+        std::lock_guard<std::mutex> lock(shared_mutex_);
+        for (auto it = shared_textures_.begin(); it != shared_textures_.end();) {
+            auto texture = it->second.lock();
+            if (!texture) {
+                it = shared_textures_.erase(it);
+                continue;
+            }
+
+            uint64_t stamp = texture->last_used_frame.load(std::memory_order_relaxed);
+            if (texture->ready.load(std::memory_order_acquire) && stamp < frame) {
+                candidates.push_back({stamp, std::move(texture)});
+            }
+            ++it;
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const c_eviction_candidate& a, const c_eviction_candidate& b) {
+        return a.last_used_frame < b.last_used_frame;
+    });
+
+    for (const auto& candidate : candidates) {
+        if (total_memory_usage_.load(std::memory_order_relaxed) <= memory_budget_.load(std::memory_order_relaxed)) {
+            break;
+        }
+        evict_texture(candidate.texture, frame);
+    }
+}
+
 size_t c_texture_cache::get_queue_size() const {
     std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(queue_mutex_));
-    return task_queue_.size();
+    return static_cast<size_t>(std::count_if(pending_.begin(), pending_.end(), [](const auto& pending) {
+        return !pending.second.in_flight;
+    }));
 }
 
 int c_texture_cache::get_active_workers() const {
     return active_workers_.load(std::memory_order_relaxed);
+}
+
+void c_texture_cache::set_texel_layout(e_texel_layout layout) {
+    texel_layout_.store(layout, std::memory_order_relaxed);
+}
+
+e_texel_layout c_texture_cache::get_texel_layout() const {
+    return texel_layout_.load(std::memory_order_relaxed);
+}
+
+void c_texture_cache::set_max_texture_size(int max_dimension) {
+    max_texture_size_.store((max_dimension > 0) ? max_dimension : 0, std::memory_order_relaxed);
+}
+
+int c_texture_cache::get_max_texture_size() const {
+    return max_texture_size_.load(std::memory_order_relaxed);
+}
+
+void c_texture_cache::set_texture_compression(e_texture_compression compression) {
+    texture_compression_.store(compression, std::memory_order_relaxed);
+}
+
+void c_texture_cache::set_progressive_decode(bool enabled) {
+    progressive_decode_.store(enabled, std::memory_order_relaxed);
+}
+
+bool c_texture_cache::get_progressive_decode() const {
+    return progressive_decode_.load(std::memory_order_relaxed);
+}
+
+e_texture_compression c_texture_cache::get_texture_compression() const {
+    return texture_compression_.load(std::memory_order_relaxed);
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <functional>
 #include <mutex>
 #include <thread>
 #include <atomic>
@@ -10,28 +12,280 @@
 #include <condition_variable>
 #include <array>
 #include <shared_mutex>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include "../jobs/job_system.hpp"
 
+// encoded image bytes shared between the downloader, the api cache and queued decode tasks
+using c_encoded_data = std::shared_ptr<const std::vector<unsigned char>>;
 
-struct c_decoded_texture {
-    std::vector<unsigned char> pixels;
+// pixel storage adopted from whatever produced it (the image decoder's own allocation, a vector, ...)
+// so decoded pixels never have to be copied into place. owner keeps the allocation alive
+class c_texel_buffer {
+public:
+    c_texel_buffer() = default;
+    c_texel_buffer(unsigned char* data, size_t size, std::shared_ptr<void> owner)
+        : data_(data), size_(size), owner_(std::move(owner)) {}
+
+    static c_texel_buffer from_vector(std::vector<unsigned char>&& pixels) {
+        auto owner = std::make_shared<std::vector<unsigned char>>(std::move(pixels));
+        return c_texel_buffer(owner->data(), owner->size(), owner);
+    }
+
+    unsigned char* data() { return data_; }
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    unsigned char& operator[](size_t index) { return data_[index]; }
+    const unsigned char& operator[](size_t index) const { return data_[index]; }
+
+    void reset() {
+        data_ = nullptr;
+        size_ = 0;
+        owner_.reset();
+    }
+
+private:
+    unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+    std::shared_ptr<void> owner_;
+};
+
+// storage order of texels inside every texture level. tiled keeps each 4x4 block contiguous, 64 bytes or
+// one cache line, so bilinear taps and rotated-triangle scans touch far fewer lines than row-major rows do
+enum class e_texel_layout {
+    linear,
+    tiled
+};
+
+// byte offset of texel (x, y) in a level of the given width. tiled levels are padded to whole blocks
+template <e_texel_layout t_layout>
+inline int texel_offset(int x, int y, int width) {
+    if constexpr (t_layout == e_texel_layout::tiled) {
+        const int blocks_per_row = (width + 3) >> 2;
+        return (((((y >> 2) * blocks_per_row) + (x >> 2)) << 4) + ((y & 3) << 2) + (x & 3)) << 2;
+    }
+    else {
+        return (y * width + x) * 4;
+    }
+}
+
+// how a texture's levels are stored in memory. palette holds 8 bit indices into the texture's 256 entry palette,
+// bc1 holds 8 byte blocks of 4x4 texels (two 565 endpoints and 2 bit selectors, 1 bit alpha)
+enum class e_texel_format {
+    rgba8,
+    palette,
+    bc1
+};
+
+// residency format the decode workers aim for. palette keeps textures with at most 256 colours losslessly,
+// bc1 does the same and block-compresses the rest
+enum class e_texture_compression {
+    none,
+    palette,
+    bc1
+};
+
+// what a decode worker is asked to produce. the disk tier keeps one entry per image and settings
+struct c_texture_decode_settings {
+    int max_dimension = 0;
+    e_texture_compression compression = e_texture_compression::none;
+    e_texel_layout layout = e_texel_layout::linear;
+};
+
+// bc1 colour c of a block with endpoints c0/c1, packed rgba8 like IM_COL32
+inline uint32_t bc1_color(uint32_t c0, uint32_t c1, uint32_t code) {
+    const uint32_t r0 = ((c0 >> 11) & 31) * 255 / 31, g0 = ((c0 >> 5) & 63) * 255 / 63, b0 = (c0 & 31) * 255 / 31;
+    const uint32_t r1 = ((c1 >> 11) & 31) * 255 / 31, g1 = ((c1 >> 5) & 63) * 255 / 63, b1 = (c1 & 31) * 255 / 31;
+    uint32_t r, g, b;
+    switch (code) {
+    case 0:
+        r = r0; g = g0; b = b0;
+        break;
+    case 1:
+        r = r1; g = g1; b = b1;
+        break;
+    case 2:
+        if (c0 > c1) {
+            r = (2 * r0 + r1) / 3; g = (2 * g0 + g1) / 3; b = (2 * b0 + b1) / 3;
+        }
+        else {
+            r = (r0 + r1) / 2; g = (g0 + g1) / 2; b = (b0 + b1) / 2;
+        }
+        break;
+    default:
+        if (c0 <= c1) {
+            return 0; // transparent black
+        }
+        r = (r0 + 2 * r1) / 3; g = (g0 + 2 * g1) / 3; b = (b0 + 2 * b1) / 3;
+        break;
+    }
+    return r | (g << 8) | (b << 16) | (255u << 24);
+}
+
+// texel (x, y) of one level as packed rgba8, red in the low byte. layout only applies to rgba8 levels,
+// palette indices are row-major and bc1 blocks are laid out like tiled blocks
+template <e_texel_format t_format, e_texel_layout t_layout>
+inline uint32_t fetch_texel(const unsigned char* data, const unsigned char* palette, int x, int y, int width) {
+    uint32_t texel;
+    if constexpr (t_format == e_texel_format::palette) {
+        std::memcpy(&texel, palette + data[y * width + x] * 4, sizeof(texel));
+    }
+    else if constexpr (t_format == e_texel_format::bc1) {
+        const unsigned char* block = data + ((y >> 2) * ((width + 3) >> 2) + (x >> 2)) * 8;
+        const uint32_t c0 = block[0] | (block[1] << 8);
+        const uint32_t c1 = block[2] | (block[3] << 8);
+        const uint32_t code = (block[4 + (y & 3)] >> ((x & 3) * 2)) & 3;
+        texel = bc1_color(c0, c1, code);
+    }
+    else {
+        std::memcpy(&texel, data + texel_offset<t_layout>(x, y, width), sizeof(texel));
+    }
+    return texel;
+}
+
+// full resolution rgba8 straight from the image decoder
+struct c_decoded_image {
+    c_texel_buffer pixels;
+    int width = 0;
+    int height = 0;
+};
+
+// one box-filtered level of a texture's mip chain, level 1 is half the size of the base image
+struct c_texture_mip {
+    c_texel_buffer pixels;
     int width = 0;
     int height = 0;
+};
+
+struct c_decoded_texture {
+    c_texel_buffer pixels;
+    int width = 0; // stored size, smaller than the source when downscaled on decode
+    int height = 0;
+    int source_width = 0; // size of the encoded image
+    int source_height = 0;
     int channels = 4;
     std::atomic<bool> ready{false};
     std::atomic<bool> decoding{false};
+    std::atomic<bool> preview{false}; // levels are a small stand-in until the full quality ones are swapped in
+    std::atomic<int> coverage_priority{0}; // decode priority earned by the screen area last reported for it
     float inv_width = 0.0f;
     float inv_height = 0.0f;
+    std::atomic<uint64_t> last_used_frame{0}; // stamped by get_texture, textures used this frame are never evicted
+    std::atomic<bool> evicted{false}; // levels dropped by the budget, the next get_texture queues a decode again
+    c_encoded_data encoded; // set once on creation, what an evicted texture is decoded from again
+    int max_dimension = 0; // size cap of the last decode, guarded by the cache's queue_mutex_
+    std::vector<c_texture_mip> mips; // levels 1..n down to 1x1, built by the decode worker
+    e_texel_layout layout = e_texel_layout::linear; // shared by the base image and all mips
+    e_texel_format format = e_texel_format::rgba8; // likewise
+    c_texel_buffer palette; // 256 rgba8 entries when format is palette
+    std::string content_key; // cdn hash (or the encoded buffer's identity) the shared store files this texture under
+
+    size_t memory_size() const {
+        size_t size = pixels.size() + palette.size();
+        for (const auto& mip : mips) {
+            size += mip.pixels.size();
+        }
+        return size;
+    }
 
     inline void update_metrics() {
         inv_width = (width > 0) ? (1.0f / static_cast<float>(width)) : 0.0f;
         inv_height = (height > 0) ? (1.0f / static_cast<float>(height)) : 0.0f;
     }
 
+    // 2x2 box filter of the base image down to 1x1, expects the linear layout
+    void build_mips();
+
+    // reorders the base image and every mip into 4x4 blocks, rgba8 only
+    void convert_to_tiled();
+
+    // re-encodes a linear rgba8 texture and its mips, false leaves it untouched (palette with too many colours)
+    bool compress(e_texture_compression compression);
+
+    // resamples a linear base image so neither side exceeds max_dimension, keeping the aspect ratio.
+    // mips have to be rebuilt afterwards
+    void downscale(int max_dimension);
+
+    // drops every level, only for textures that are not (or no longer) published
+    void release_levels() {
+        pixels.reset();
+        palette.reset();
+        mips.clear();
+    }
+
+    // mip level for a triangle from its uv and screen-space corners: log2 of texels per pixel
+    float triangle_lod(const float (&uv)[3][2], const float (&screen)[3][2]) const {
+        float uv_area = std::abs((uv[1][0] - uv[0][0]) * (uv[2][1] - uv[0][1]) - (uv[2][0] - uv[0][0]) * (uv[1][1] - uv[0][1])) *
+            static_cast<float>(width) * static_cast<float>(height);
+        float screen_area = std::abs((screen[1][0] - screen[0][0]) * (screen[2][1] - screen[0][1]) -
+            (screen[2][0] - screen[0][0]) * (screen[1][1] - screen[0][1]));
+        if (uv_area <= 0.0f || screen_area <= 0.0f) {
+            return 0.0f;
+        }
+        return 0.5f * std::log2(uv_area / screen_area);
+    }
+
     inline void sample(float u, float v, float& r, float& g, float& b, float& a) const {
         if (!ready.load(std::memory_order_acquire) || pixels.empty() || width <= 0 || height <= 0) {
             r = g = b = a = 0.0f;
             return;
         }
+        sample_level(pixels.data(), width, height, u, v, r, g, b, a);
+    }
+
+    // mip level nearest to lod, clamped to the chain
+    int mip_level(float lod) const {
+        int level = (lod > 0.0f) ? static_cast<int>(lod + 0.5f) : 0;
+        return (level < static_cast<int>(mips.size())) ? level : static_cast<int>(mips.size());
+    }
+
+    const unsigned char* level_pixels(int level, int& level_width, int& level_height) const {
+        if (level <= 0 || mips.empty()) {
+            level_width = width;
+            level_height = height;
+            return pixels.data();
+        }
+        const c_texture_mip& mip = mips[(level <= static_cast<int>(mips.size())) ? level - 1 : mips.size() - 1];
+        level_width = mip.width;
+        level_height = mip.height;
+        return mip.pixels.data();
+    }
+
+    // bilinear fetch from the mip level nearest to lod, lod <= 0 reads the base image
+    inline void sample_lod(float u, float v, float lod, float& r, float& g, float& b, float& a) const {
+        if (!ready.load(std::memory_order_acquire) || pixels.empty() || width <= 0 || height <= 0) {
+            r = g = b = a = 0.0f;
+            return;
+        }
+        int level_width = 0, level_height = 0;
+        const unsigned char* level = level_pixels(mip_level(lod), level_width, level_height);
+        sample_level(level, level_width, level_height, u, v, r, g, b, a);
+    }
+
+private:
+    inline void sample_level(const unsigned char* pixels, int width, int height,
+                             float u, float v, float& r, float& g, float& b, float& a) const {
+        const unsigned char* colors = palette.data();
+        if (format == e_texel_format::palette) {
+            sample_texels<e_texel_format::palette, e_texel_layout::linear>(pixels, colors, width, height, u, v, r, g, b, a);
+        }
+        else if (format == e_texel_format::bc1) {
+            sample_texels<e_texel_format::bc1, e_texel_layout::linear>(pixels, colors, width, height, u, v, r, g, b, a);
+        }
+        else if (layout == e_texel_layout::tiled) {
+            sample_texels<e_texel_format::rgba8, e_texel_layout::tiled>(pixels, colors, width, height, u, v, r, g, b, a);
+        }
+        else {
+            sample_texels<e_texel_format::rgba8, e_texel_layout::linear>(pixels, colors, width, height, u, v, r, g, b, a);
+        }
+    }
+
+    template <e_texel_format t_format, e_texel_layout t_layout>
+    static inline void sample_texels(const unsigned char* pixels, const unsigned char* colors, int width, int height,
+                                     float u, float v, float& r, float& g, float& b, float& a) {
         u = (u < 0.0f) ? 0.0f : ((u > 1.0f) ? 1.0f : u);
         v = (v < 0.0f) ? 0.0f : ((v > 1.0f) ? 1.0f : v);
         float fx = u * (width - 1.0f);
@@ -43,28 +297,27 @@ struct c_decoded_texture {
         int y1 = (y0 < height - 1) ? (y0 + 1) : y0;
         float frac_x = fx - x0;
         float frac_y = fy - y0;
-        const int stride = width * 4;
-        const int idx00 = y0 * stride + x0 * 4;
-        const int idx10 = y0 * stride + x1 * 4;
-        const int idx01 = y1 * stride + x0 * 4;
-        const int idx11 = y1 * stride + x1 * 4;
+        const uint32_t p00 = fetch_texel<t_format, t_layout>(pixels, colors, x0, y0, width);
+        const uint32_t p10 = fetch_texel<t_format, t_layout>(pixels, colors, x1, y0, width);
+        const uint32_t p01 = fetch_texel<t_format, t_layout>(pixels, colors, x0, y1, width);
+        const uint32_t p11 = fetch_texel<t_format, t_layout>(pixels, colors, x1, y1, width);
         float inv_255 = 1.0f / 255.0f;
-        float r00 = pixels[idx00] * inv_255;
-        float g00 = pixels[idx00 + 1] * inv_255;
-        float b00 = pixels[idx00 + 2] * inv_255;
-        float a00 = pixels[idx00 + 3] * inv_255;
-        float r10 = pixels[idx10] * inv_255;
-        float g10 = pixels[idx10 + 1] * inv_255;
-        float b10 = pixels[idx10 + 2] * inv_255;
-        float a10 = pixels[idx10 + 3] * inv_255;
-        float r01 = pixels[idx01] * inv_255;
-        float g01 = pixels[idx01 + 1] * inv_255;
-        float b01 = pixels[idx01 + 2] * inv_255;
-        float a01 = pixels[idx01 + 3] * inv_255;
-        float r11 = pixels[idx11] * inv_255;
-        float g11 = pixels[idx11 + 1] * inv_255;
-        float b11 = pixels[idx11 + 2] * inv_255;
-        float a11 = pixels[idx11 + 3] * inv_255;
+        float r00 = (p00 & 0xFF) * inv_255;
+        float g00 = ((p00 >> 8) & 0xFF) * inv_255;
+        float b00 = ((p00 >> 16) & 0xFF) * inv_255;
+        float a00 = (p00 >> 24) * inv_255;
+        float r10 = (p10 & 0xFF) * inv_255;
+        float g10 = ((p10 >> 8) & 0xFF) * inv_255;
+        float b10 = ((p10 >> 16) & 0xFF) * inv_255;
+        float a10 = (p10 >> 24) * inv_255;
+        float r01 = (p01 & 0xFF) * inv_255;
+        float g01 = ((p01 >> 8) & 0xFF) * inv_255;
+        float b01 = ((p01 >> 16) & 0xFF) * inv_255;
+        float a01 = (p01 >> 24) * inv_255;
+        float r11 = (p11 & 0xFF) * inv_255;
+        float g11 = ((p11 >> 8) & 0xFF) * inv_255;
+        float b11 = ((p11 >> 16) & 0xFF) * inv_255;
+        float a11 = (p11 >> 24) * inv_255;
         float r0 = r00 + (r10 - r00) * frac_x;
         float r1 = r01 + (r11 - r01) * frac_x;
         r = r0 + (r1 - r0) * frac_y;
@@ -80,13 +333,33 @@ struct c_decoded_texture {
     }
 };
 
+// references into the content-keyed store, players wearing the same item share one decoded texture.
+// never modified once published, a change copies the table and swaps it in so get_texture reads it without locks
+struct c_user_texture_table {
+    std::unordered_map<int, std::shared_ptr<c_decoded_texture>> textures;
+    std::shared_ptr<c_decoded_texture> face_texture;
+};
+
 struct c_user_texture_cache {
-    std::unordered_map<int, std::unique_ptr<c_decoded_texture>> textures;
-    std::unique_ptr<c_decoded_texture> face_texture;
-    mutable std::shared_mutex mutex; // Allow concurrent reads
-    std::atomic<size_t> memory_usage{0};
+    std::atomic<const c_user_texture_table*> table{nullptr};
 
-    c_user_texture_cache() : face_texture(std::make_unique<c_decoded_texture>()) {}
+    c_user_texture_cache() = default;
+    c_user_texture_cache(const c_user_texture_cache&) = delete;
+    c_user_texture_cache& operator=(const c_user_texture_cache&) = delete;
+    ~c_user_texture_cache() { delete table.load(std::memory_order_relaxed); }
+};
+
+// pins everything get_texture can reach from the calling thread. textures looked up under a guard are not
+// evicted before it ends (even if another thread begins a new frame), and tables and textures that clear_user
+// unlinks meanwhile are freed only afterwards, so the pointers stay usable for the guard's whole lifetime.
+// guards nest, hold one across a frame and look textures up once
+class c_texture_read_guard {
+public:
+    c_texture_read_guard();
+    ~c_texture_read_guard();
+
+    c_texture_read_guard(const c_texture_read_guard&) = delete;
+    c_texture_read_guard& operator=(const c_texture_read_guard&) = delete;
 };
 
 class c_texture_cache {
@@ -96,51 +369,203 @@ public:
         return instance;
     }
 
-    void initialize(int worker_count = 0);
+    // memory_budget_mb 0 keeps the default budget. decodes run on c_job_system, which owns the thread count
+    void initialize(size_t memory_budget_mb = 0);
+
+    // call once per rendered frame before any get_texture, pointers returned during the previous frame
+    // may be evicted after this. also frees whatever readers have stopped pinning
+    void begin_frame();
+
+    // content_hash is the texture's cdn hash, textures with the same hash are decoded and stored once.
+    // without one only requests passing the same c_encoded_data share the texture
+    // max_dimension caps the stored size of this texture, 0 uses set_max_texture_size
+    void request_texture(const std::string& user_id, int texture_index,
+                        c_encoded_data data, bool high_priority = false, const std::string& content_hash = "",
+                        int max_dimension = 0);
+    void request_face_texture(const std::string& user_id, c_encoded_data data, const std::string& content_hash = "",
+                             int max_dimension = 0);
+
+    // copying overloads for callers that do not hold the bytes in a c_encoded_data
     void request_texture(const std::string& user_id, int texture_index,
                         const std::vector<unsigned char>& data, bool high_priority = false);
     void request_face_texture(const std::string& user_id,
                              const std::vector<unsigned char>& data);
+
+    // screen area in pixels the texture covered this frame, reported by the render loop for every textured
+    // submesh. queued decodes of the textures covering the most move ahead of the rest
+    void report_coverage(const std::string& user_id, int texture_index, float pixels);
+    void report_face_coverage(const std::string& user_id, float pixels);
+
+    // lock-free, safe to call per face. a texture returned here is neither evicted nor freed during the
+    // current frame, or before the caller's c_texture_read_guard ends
     c_decoded_texture* get_texture(const std::string& user_id, int texture_index);
     c_decoded_texture* get_face_texture(const std::string& user_id);
+
+    // drops the user's references, a texture's memory is released once no user holds it. decodes nobody
+    // else is waiting on are cancelled, queued ones never start and in-flight ones are discarded
     void clear_user(const std::string& user_id);
     void clear_all();
     size_t get_memory_usage() const;
-    size_t get_queue_size() const;
-    int get_active_workers() const;
+    size_t get_memory_budget() const;
+    size_t get_eviction_count() const;
+    size_t get_evicted_bytes() const;
+    size_t get_shared_hit_count() const;
+    // where requests were served from: already resident, mapped from the disk tier, or decoded
+    size_t get_memory_hit_count() const;
+    size_t get_disk_hit_count() const;
+    size_t get_decode_count() const;
+    size_t get_queue_size() const; // distinct textures waiting for a worker
+    int get_active_workers() const; // decodes running on the job system right now
+
+    // layout produced by subsequent decodes, textures already decoded keep theirs
+    void set_texel_layout(e_texel_layout layout);
+    e_texel_layout get_texel_layout() const;
+
+    // larger images are downscaled by the decode worker before they are published, 0 keeps full resolution
+    void set_max_texture_size(int max_dimension);
+    int get_max_texture_size() const;
+
+    // residency format of subsequent decodes, compressed textures ignore the tiled layout.
+    // memory accounting and the budget see the compressed size
+    void set_texture_compression(e_texture_compression compression);
+    e_texture_compression get_texture_compression() const;
+
+    // large images are first published as a small preview straight from the decoder. the full quality levels
+    // (downscaled, mipped, compressed) are built once every first decode ahead of them is done and swapped into
+    // the same texture by begin_frame, once no reader can still be drawing the preview
+    void set_progressive_decode(bool enabled);
+    bool get_progressive_decode() const;
 
 private:
-    c_texture_cache() = default;
+    friend class c_texture_read_guard;
+
+    c_texture_cache();
     ~c_texture_cache();
+
+    // epoch based reclamation of everything the lock-free read path touches. a reader publishes the epoch it
+    // entered at in its slot, an unlinked object is retired with the current epoch and freed once no slot holds
+    // an epoch at or below it and the frame it was retired in is over
+    struct alignas(64) c_reader_slot {
+        std::atomic<uint64_t> epoch{0}; // 0 while the owning thread holds no guard
+        std::atomic<uint64_t> frame{0}; // frame the guard was entered in
+        std::atomic<bool> claimed{false};
+    };
+
+    struct c_retired_object {
+        uint64_t epoch;
+        uint64_t frame; // unguarded get_texture callers may use it until begin_frame
+        std::shared_ptr<const void> object;
+    };
+
+    using c_user_directory = std::unordered_map<std::string, std::shared_ptr<c_user_texture_cache>>;
+    // one per texture being decoded, however many users asked for it. requests for a texture already in here
+    // only add their user, or raise the priority which re-queues it under a new sequence
+    struct c_pending_decode {
+        std::shared_ptr<c_decoded_texture> texture;
+        c_encoded_data data;
+        std::unordered_set<std::string> users; // cancelled once all of them are cleared
+        int priority = 0;
+        int max_dimension = 0; // largest any request allowed, 0 if one asked for full resolution
+        uint64_t sequence = 0; // the task_queue_ entry that currently stands for this decode
+        bool in_flight = false;
+        bool cancelled = false; // in flight with no user left, the worker throws the result away
+        bool upgrade = false; // texture is a published preview, the full quality version is what's left
+        c_decoded_image source; // the preview's decoded image, kept so the upgrade doesn't decode it again
+    };
+
+    // queue entries are never updated in place, ones whose sequence no longer matches the pending decode are skipped
     struct decode_task {
-        std::string user_id;
-        int texture_index;
-        std::vector<unsigned char> data;
-        bool is_face;
-        int priority; 
+        std::string content_key;
+        int priority;
+        uint64_t sequence;
+        bool upgrade;
 
         bool operator<(const decode_task& other) const {
-            return priority < other.priority; // Priority queue sorts in reverse
+            if (upgrade != other.upgrade) {
+                return upgrade; // previews of everything first
+            }
+            if (priority != other.priority) {
+                return priority < other.priority; // Priority queue sorts in reverse
+            }
+            return sequence > other.sequence; // first come first served within a priority
         }
     };
-    void worker_thread(int worker_id);
-    bool decode_texture(const std::string& user_id, int texture_index,
-                       const std::vector<unsigned char>& data);
-    bool decode_face_texture(const std::string& user_id,
-                            const std::vector<unsigned char>& data);
-    c_user_texture_cache* get_user_cache(const std::string& user_id);
-    std::unordered_map<std::string, std::unique_ptr<c_user_texture_cache>> cache_;
-    mutable std::shared_mutex cache_mutex_;
+    void schedule_decode(const std::string& content_key, const c_pending_decode& pending);
+    void run_decode();
+    void request_shared(const std::string& user_id, int texture_index, c_encoded_data data,
+                        int priority, const std::string& content_hash, int max_dimension);
+    decode_task make_task(const std::string& content_key, const c_pending_decode& pending) const;
+    std::shared_ptr<c_decoded_texture> create_texture(const std::string& content_key);
+    std::shared_ptr<c_decoded_texture> acquire_shared_texture(const std::string& content_key, const c_encoded_data& data);
+    void update_coverage(c_decoded_texture& texture, float pixels);
+    static int coverage_priority(float pixels);
+    c_texture_decode_settings decode_settings(int max_dimension) const;
+    void prune_shared_textures();
+    void cancel_decodes(const std::string* user_id);
+    bool decode_pixels(c_decoded_texture& texture, const std::vector<unsigned char>& data, int max_dimension,
+                      const std::function<bool()>& cancelled, c_decoded_image& source);
+    bool upgrade_texture(const std::shared_ptr<c_decoded_texture>& preview, const std::vector<unsigned char>& data,
+                         c_decoded_image source, int max_dimension, const std::function<bool()>& cancelled);
+    void publish_texture(c_decoded_texture& texture);
+    void apply_upgrades();
+    bool swap_levels(c_decoded_texture& texture, c_decoded_texture& levels, uint64_t frame);
+    void enter_read();
+    void exit_read();
+    void retire(std::shared_ptr<const void> object);
+    void reclaim(std::vector<c_retired_object>& expired);
+    uint64_t eviction_frame() const;
+    const c_user_texture_table* find_user_table(const std::string& user_id) const;
+    c_decoded_texture* use_texture(const std::string& user_id, const std::shared_ptr<c_decoded_texture>& texture, int priority);
+    void reload_texture(const std::string& user_id, const std::shared_ptr<c_decoded_texture>& texture, int priority);
+    c_user_texture_cache& get_user_cache(const std::string& user_id);
+    void publish_users(std::unique_ptr<c_user_directory> users);
+    void publish_user_table(c_user_texture_cache& user_cache, std::unique_ptr<c_user_texture_table> table);
+    void enforce_budget();
+    bool evict_texture(const std::shared_ptr<c_decoded_texture>& texture, uint64_t frame);
+    static constexpr size_t max_reader_threads = 64;
+    std::atomic<const c_user_directory*> users_{nullptr};
+    std::mutex cache_mutex_; // serializes everyone replacing users_ or a user's table
+    std::array<c_reader_slot, max_reader_threads> reader_slots_;
+    std::atomic<uint64_t> global_epoch_{1};
+    std::atomic<int> unslotted_readers_{0}; // readers beyond max_reader_threads, they hold off all reclamation
+    std::vector<c_retired_object> retired_;
+    std::mutex retire_mutex_;
+    std::unordered_map<std::string, std::weak_ptr<c_decoded_texture>> shared_textures_;
+    std::mutex shared_mutex_;
+    std::atomic<size_t> shared_hit_count_{0};
+    std::atomic<size_t> memory_hit_count_{0};
+    std::atomic<size_t> disk_hit_count_{0};
+    std::atomic<size_t> decode_count_{0};
+    // full quality levels waiting for begin_frame to swap them into their preview
+    struct c_staged_upgrade {
+        std::shared_ptr<c_decoded_texture> texture;
+        std::unique_ptr<c_decoded_texture> levels;
+    };
+    std::vector<c_staged_upgrade> staged_upgrades_;
+    std::mutex upgrade_mutex_;
     std::priority_queue<decode_task> task_queue_;
+    std::unordered_map<std::string, c_pending_decode> pending_; // by content key, guarded by queue_mutex_
+    uint64_t next_sequence_ = 0;
     std::mutex queue_mutex_;
-    std::condition_variable queue_cv_;
-    std::vector<std::thread> workers_;
+    std::condition_variable idle_cv_; // signalled as decode jobs finish, the destructor waits for all of them
+    int scheduled_decodes_ = 0; // decode jobs submitted and not finished, guarded by queue_mutex_
     std::atomic<bool> running_{false};
     std::atomic<int> active_workers_{0};
     std::atomic<size_t> total_memory_usage_{0};
-    static constexpr int default_worker_count = 3;
+    std::atomic<size_t> memory_budget_{max_memory_mb * 1024 * 1024};
+    std::atomic<uint64_t> current_frame_{1};
+    std::atomic<size_t> eviction_count_{0};
+    std::atomic<size_t> evicted_bytes_{0};
+    std::mutex eviction_mutex_;
+    std::atomic<e_texel_layout> texel_layout_{e_texel_layout::linear};
+    std::atomic<int> max_texture_size_{0};
+    std::atomic<e_texture_compression> texture_compression_{e_texture_compression::none};
+    std::atomic<bool> progressive_decode_{true};
     static constexpr int priority_face = 100;
     static constexpr int priority_high = 50;
     static constexpr int priority_normal = 10;
+    static constexpr int priority_coverage_step = 8; // per 4x the screen area
+    static constexpr int max_coverage_priority = 80;
+    static constexpr int preview_dimension = 64;
     static constexpr size_t max_memory_mb = 512; // MB
 };
\ No newline at end of file
@@ -0,0 +1,357 @@
+#include "texture_sampler.hpp"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SAMPLER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// gcc and clang only emit vector code for the isa a function is tagged with, msvc takes any intrinsic
+#if defined(__GNUC__) || defined(__clang__)
+#define SAMPLER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SAMPLER_TARGET(isa)
+#endif
+
+namespace {
+    // 14 bit weights keep the coordinate rounding far below one lsb and still fit a signed 16 bit multiply-add
+    constexpr int weight_bits = 14;
+    constexpr int weight_one = 1 << weight_bits;
+    constexpr int weight_mask = weight_one - 1;
+
+    // horizontal results drop 7 bits so a (top, bottom) pair packs into one 32 bit lane for the vertical pass
+    constexpr int horizontal_shift = 7;
+    constexpr int vertical_shift = 2 * weight_bits - horizontal_shift;
+
+    struct c_sample_level {
+        const unsigned char* pixels = nullptr;
+        const unsigned char* palette = nullptr;
+        int width = 0;
+        int height = 0;
+        int blocks_per_row = 0;
+        float scale_x = 0.0f; // (width - 1) << weight_bits, maps u onto fixed point texel coordinates
+        float scale_y = 0.0f;
+    };
+
+    inline float clamp_unit(float x) {
+        return (x > 0.0f) ? ((x < 1.0f) ? x : 1.0f) : 0.0f;
+    }
+
+    // the vector paths below do exactly this integer math, so all isas return identical texels
+    template <e_texel_format t_format, e_texel_layout t_layout>
+    inline uint32_t sample_fixed(const c_sample_level& level, float u, float v) {
+        const int fx = static_cast<int>(clamp_unit(u) * level.scale_x + 0.5f);
+        const int fy = static_cast<int>((1.0f - clamp_unit(v)) * level.scale_y + 0.5f);
+        const int x0 = fx >> weight_bits;
+        const int y0 = fy >> weight_bits;
+        const int x1 = (x0 < level.width - 1) ? (x0 + 1) : x0;
+        const int y1 = (y0 < level.height - 1) ? (y0 + 1) : y0;
+        const uint32_t wx = static_cast<uint32_t>(fx & weight_mask);
+        const uint32_t wy = static_cast<uint32_t>(fy & weight_mask);
+
+        const uint32_t p00 = fetch_texel<t_format, t_layout>(level.pixels, level.palette, x0, y0, level.width);
+        const uint32_t p10 = fetch_texel<t_format, t_layout>(level.pixels, level.palette, x1, y0, level.width);
+        const uint32_t p01 = fetch_texel<t_format, t_layout>(level.pixels, level.palette, x0, y1, level.width);
+        const uint32_t p11 = fetch_texel<t_format, t_layout>(level.pixels, level.palette, x1, y1, level.width);
+
+        uint32_t result = 0;
+        for (int c = 0; c < 4; ++c) {
+            const int shift = c * 8;
+            const uint32_t top = (((p00 >> shift) & 0xFF) * (weight_one - wx) + ((p10 >> shift) & 0xFF) * wx) >> horizontal_shift;
+            const uint32_t bottom = (((p01 >> shift) & 0xFF) * (weight_one - wx) + ((p11 >> shift) & 0xFF) * wx) >> horizontal_shift;
+            const uint32_t value = (top * (weight_one - wy) + bottom * wy + (1u << (vertical_shift - 1))) >> vertical_shift;
+            result |= value << shift;
+        }
+        return result;
+    }
+
+    template <e_texel_format t_format, e_texel_layout t_layout>
+    void sample_scalar(const c_sample_level& level, const float* u, const float* v, size_t count, uint32_t* out) {
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = sample_fixed<t_format, t_layout>(level, u[i], v[i]);
+        }
+    }
+
+#if defined(SAMPLER_X86)
+    inline uint32_t load_texel(const c_sample_level& level, int offset) {
+        uint32_t texel;
+        std::memcpy(&texel, level.pixels + offset, sizeof(texel));
+        return texel;
+    }
+
+    // (weight_one - w, w) pairs of pixels 0 and 1 (or 2 and 3 from the high half), each repeated for all four channels
+    SAMPLER_TARGET("sse4.1")
+    inline void weight_pairs_sse41(__m128i w, __m128i& w0, __m128i& w1, __m128i& w2, __m128i& w3) {
+        const __m128i pair = _mm_or_si128(_mm_slli_epi32(w, 16), _mm_sub_epi32(_mm_set1_epi32(weight_one), w));
+        const __m128i lo = _mm_unpacklo_epi32(pair, pair);
+        const __m128i hi = _mm_unpackhi_epi32(pair, pair);
+        w0 = _mm_unpacklo_epi64(lo, lo);
+        w1 = _mm_unpackhi_epi64(lo, lo);
+        w2 = _mm_unpacklo_epi64(hi, hi);
+        w3 = _mm_unpackhi_epi64(hi, hi);
+    }
+
+    // p00..p11 hold the four taps of 4 pixels, wx/wy their weight_bits fractions as 32 bit lanes
+    SAMPLER_TARGET("sse4.1")
+    inline __m128i bilinear_sse41(__m128i p00, __m128i p10, __m128i p01, __m128i p11, __m128i wx, __m128i wy) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi32(1 << (vertical_shift - 1));
+
+        __m128i wx0, wx1, wx2, wx3, wy0, wy1, wy2, wy3;
+        weight_pairs_sse41(wx, wx0, wx1, wx2, wx3);
+        weight_pairs_sse41(wy, wy0, wy1, wy2, wy3);
+
+        // interleaving the left and right taps lines every channel up as a (left, right) pair for madd
+        const __m128i top_01 = _mm_unpacklo_epi8(p00, p10);
+        const __m128i top_23 = _mm_unpackhi_epi8(p00, p10);
+        const __m128i bottom_01 = _mm_unpacklo_epi8(p01, p11);
+        const __m128i bottom_23 = _mm_unpackhi_epi8(p01, p11);
+
+#define SAMPLER_PIXEL(top, bottom, unpack, wx, wy) \
+        _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_or_si128( \
+            _mm_srli_epi32(_mm_madd_epi16(unpack(top, zero), wx), horizontal_shift), \
+            _mm_slli_epi32(_mm_srli_epi32(_mm_madd_epi16(unpack(bottom, zero), wx), horizontal_shift), 16)), wy), round), vertical_shift)
+        const __m128i r0 = SAMPLER_PIXEL(top_01, bottom_01, _mm_unpacklo_epi8, wx0, wy0);
+        const __m128i r1 = SAMPLER_PIXEL(top_01, bottom_01, _mm_unpackhi_epi8, wx1, wy1);
+        const __m128i r2 = SAMPLER_PIXEL(top_23, bottom_23, _mm_unpacklo_epi8, wx2, wy2);
+        const __m128i r3 = SAMPLER_PIXEL(top_23, bottom_23, _mm_unpackhi_epi8, wx3, wy3);
+#undef SAMPLER_PIXEL
+
+        return _mm_packus_epi16(_mm_packus_epi32(r0, r1), _mm_packus_epi32(r2, r3));
+    }
+
+    template <e_texel_layout t_layout>
+    SAMPLER_TARGET("sse4.1")
+    void sample_sse41(const c_sample_level& level, const float* u, const float* v, size_t count, uint32_t* out) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 scale_x = _mm_set1_ps(level.scale_x);
+        const __m128 scale_y = _mm_set1_ps(level.scale_y);
+        const __m128i step = _mm_set1_epi32(1);
+        const __m128i max_x = _mm_set1_epi32(level.width - 1);
+        const __m128i max_y = _mm_set1_epi32(level.height - 1);
+        const __m128i fraction = _mm_set1_epi32(weight_mask);
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128 uu = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(u + i), zero), one);
+            const __m128 vv = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(v + i), zero), one);
+            const __m128i fx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(uu, scale_x), half));
+            const __m128i fy = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, vv), scale_y), half));
+
+            alignas(16) int x0[4], x1[4], y0[4], y1[4];
+            const __m128i vx0 = _mm_srli_epi32(fx, weight_bits);
+            const __m128i vy0 = _mm_srli_epi32(fy, weight_bits);
+            _mm_store_si128(reinterpret_cast<__m128i*>(x0), vx0);
+            _mm_store_si128(reinterpret_cast<__m128i*>(y0), vy0);
+            _mm_store_si128(reinterpret_cast<__m128i*>(x1), _mm_min_epi32(_mm_add_epi32(vx0, step), max_x));
+            _mm_store_si128(reinterpret_cast<__m128i*>(y1), _mm_min_epi32(_mm_add_epi32(vy0, step), max_y));
+
+            // no gather before avx2, the taps are inserted lane by lane
+            __m128i p00 = _mm_cvtsi32_si128(static_cast<int>(load_texel(level, texel_offset<t_layout>(x0[0], y0[0], level.width))));
+            __m128i p10 = _mm_cvtsi32_si128(static_cast<int>(load_texel(level, texel_offset<t_layout>(x1[0], y0[0], level.width))));
+            __m128i p01 = _mm_cvtsi32_si128(static_cast<int>(load_texel(level, texel_offset<t_layout>(x0[0], y1[0], level.width))));
+            __m128i p11 = _mm_cvtsi32_si128(static_cast<int>(load_texel(level, texel_offset<t_layout>(x1[0], y1[0], level.width))));
+#define SAMPLER_INSERT(lane) \
+            p00 = _mm_insert_epi32(p00, static_cast<int>(load_texel(level, texel_offset<t_layout>(x0[lane], y0[lane], level.width))), lane); \
+            p10 = _mm_insert_epi32(p10, static_cast<int>(load_texel(level, texel_offset<t_layout>(x1[lane], y0[lane], level.width))), lane); \
+            p01 = _mm_insert_epi32(p01, static_cast<int>(load_texel(level, texel_offset<t_layout>(x0[lane], y1[lane], level.width))), lane); \
+            p11 = _mm_insert_epi32(p11, static_cast<int>(load_texel(level, texel_offset<t_layout>(x1[lane], y1[lane], level.width))), lane);
+            SAMPLER_INSERT(1)
+            SAMPLER_INSERT(2)
+            SAMPLER_INSERT(3)
+#undef SAMPLER_INSERT
+
+            const __m128i result = bilinear_sse41(p00, p10, p01, p11, _mm_and_si128(fx, fraction), _mm_and_si128(fy, fraction));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+        }
+
+        sample_scalar<e_texel_format::rgba8, t_layout>(level, u + i, v + i, count - i, out + i);
+    }
+
+    // same math as bilinear_sse41 in both 128 bit lanes, which carry pixels 0-3 and 4-7
+    SAMPLER_TARGET("avx2")
+    inline void weight_pairs_avx2(__m256i w, __m256i& w0, __m256i& w1, __m256i& w2, __m256i& w3) {
+        const __m256i pair = _mm256_or_si256(_mm256_slli_epi32(w, 16), _mm256_sub_epi32(_mm256_set1_epi32(weight_one), w));
+        const __m256i lo = _mm256_unpacklo_epi32(pair, pair);
+        const __m256i hi = _mm256_unpackhi_epi32(pair, pair);
+        w0 = _mm256_unpacklo_epi64(lo, lo);
+        w1 = _mm256_unpackhi_epi64(lo, lo);
+        w2 = _mm256_unpacklo_epi64(hi, hi);
+        w3 = _mm256_unpackhi_epi64(hi, hi);
+    }
+
+    SAMPLER_TARGET("avx2")
+    inline __m256i bilinear_avx2(__m256i p00, __m256i p10, __m256i p01, __m256i p11, __m256i wx, __m256i wy) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i round = _mm256_set1_epi32(1 << (vertical_shift - 1));
+
+        __m256i wx0, wx1, wx2, wx3, wy0, wy1, wy2, wy3;
+        weight_pairs_avx2(wx, wx0, wx1, wx2, wx3);
+        weight_pairs_avx2(wy, wy0, wy1, wy2, wy3);
+
+        const __m256i top_01 = _mm256_unpacklo_epi8(p00, p10);
+        const __m256i top_23 = _mm256_unpackhi_epi8(p00, p10);
+        const __m256i bottom_01 = _mm256_unpacklo_epi8(p01, p11);
+        const __m256i bottom_23 = _mm256_unpackhi_epi8(p01, p11);
+
+#define SAMPLER_PIXEL(top, bottom, unpack, wx, wy) \
+        _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_or_si256( \
+            _mm256_srli_epi32(_mm256_madd_epi16(unpack(top, zero), wx), horizontal_shift), \
+            _mm256_slli_epi32(_mm256_srli_epi32(_mm256_madd_epi16(unpack(bottom, zero), wx), horizontal_shift), 16)), wy), round), vertical_shift)
+        const __m256i r0 = SAMPLER_PIXEL(top_01, bottom_01, _mm256_unpacklo_epi8, wx0, wy0);
+        const __m256i r1 = SAMPLER_PIXEL(top_01, bottom_01, _mm256_unpackhi_epi8, wx1, wy1);
+        const __m256i r2 = SAMPLER_PIXEL(top_23, bottom_23, _mm256_unpacklo_epi8, wx2, wy2);
+        const __m256i r3 = SAMPLER_PIXEL(top_23, bottom_23, _mm256_unpackhi_epi8, wx3, wy3);
+#undef SAMPLER_PIXEL
+
+        return _mm256_packus_epi16(_mm256_packus_epi32(r0, r1), _mm256_packus_epi32(r2, r3));
+    }
+
+    // byte offsets of 8 texels, texel_offset in vector form
+    template <e_texel_layout t_layout>
+    SAMPLER_TARGET("avx2")
+    inline __m256i texel_offsets_avx2(__m256i x, __m256i y, __m256i width, __m256i blocks_per_row) {
+        if constexpr (t_layout == e_texel_layout::tiled) {
+            const __m256i three = _mm256_set1_epi32(3);
+            const __m256i block = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(y, 2), blocks_per_row),
+                                                   _mm256_srli_epi32(x, 2));
+            const __m256i inner = _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(y, three), 2), _mm256_and_si256(x, three));
+            return _mm256_slli_epi32(_mm256_add_epi32(_mm256_slli_epi32(block, 4), inner), 2);
+        }
+        else {
+            return _mm256_slli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(y, width), x), 2);
+        }
+    }
+
+    template <e_texel_layout t_layout>
+    SAMPLER_TARGET("avx2")
+    void sample_avx2(const c_sample_level& level, const float* u, const float* v, size_t count, uint32_t* out) {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 scale_x = _mm256_set1_ps(level.scale_x);
+        const __m256 scale_y = _mm256_set1_ps(level.scale_y);
+        const __m256i step = _mm256_set1_epi32(1);
+        const __m256i max_x = _mm256_set1_epi32(level.width - 1);
+        const __m256i max_y = _mm256_set1_epi32(level.height - 1);
+        const __m256i fraction = _mm256_set1_epi32(weight_mask);
+        const __m256i width = _mm256_set1_epi32(level.width);
+        const __m256i blocks_per_row = _mm256_set1_epi32(level.blocks_per_row);
+        const int* base = reinterpret_cast<const int*>(level.pixels);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256 uu = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(u + i), zero), one);
+            const __m256 vv = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(v + i), zero), one);
+            const __m256i fx = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(uu, scale_x), half));
+            const __m256i fy = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(one, vv), scale_y), half));
+
+            const __m256i x0 = _mm256_srli_epi32(fx, weight_bits);
+            const __m256i y0 = _mm256_srli_epi32(fy, weight_bits);
+            const __m256i x1 = _mm256_min_epi32(_mm256_add_epi32(x0, step), max_x);
+            const __m256i y1 = _mm256_min_epi32(_mm256_add_epi32(y0, step), max_y);
+
+            const __m256i p00 = _mm256_i32gather_epi32(base, texel_offsets_avx2<t_layout>(x0, y0, width, blocks_per_row), 1);
+            const __m256i p10 = _mm256_i32gather_epi32(base, texel_offsets_avx2<t_layout>(x1, y0, width, blocks_per_row), 1);
+            const __m256i p01 = _mm256_i32gather_epi32(base, texel_offsets_avx2<t_layout>(x0, y1, width, blocks_per_row), 1);
+            const __m256i p11 = _mm256_i32gather_epi32(base, texel_offsets_avx2<t_layout>(x1, y1, width, blocks_per_row), 1);
+
+            const __m256i result = bilinear_avx2(p00, p10, p01, p11, _mm256_and_si256(fx, fraction), _mm256_and_si256(fy, fraction));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+        }
+
+        sample_sse41<t_layout>(level, u + i, v + i, count - i, out + i);
+    }
+#endif
+
+    e_sampler_isa detect_isa() {
+#if defined(SAMPLER_X86)
+#if defined(_MSC_VER)
+        int info[4] = {};
+        __cpuid(info, 0);
+        const int max_leaf = info[0];
+        __cpuid(info, 1);
+        const bool sse41 = (info[2] & (1 << 19)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx2 = false;
+        // the os has to save ymm state too, not just the cpu supporting it
+        if (max_leaf >= 7 && avx && osxsave && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        const bool sse41 = __builtin_cpu_supports("sse4.1");
+        const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+        if (avx2 && sse41) {
+            return e_sampler_isa::avx2;
+        }
+        if (sse41) {
+            return e_sampler_isa::sse41;
+        }
+#endif
+        return e_sampler_isa::scalar;
+    }
+
+    template <e_texel_layout t_layout>
+    void sample_layout(const c_sample_level& level, const float* u, const float* v, size_t count, uint32_t* out) {
+        switch (sampler_isa()) {
+#if defined(SAMPLER_X86)
+        case e_sampler_isa::avx2:
+            sample_avx2<t_layout>(level, u, v, count, out);
+            break;
+        case e_sampler_isa::sse41:
+            sample_sse41<t_layout>(level, u, v, count, out);
+            break;
+#endif
+        default:
+            sample_scalar<e_texel_format::rgba8, t_layout>(level, u, v, count, out);
+            break;
+        }
+    }
+}
+
+e_sampler_isa sampler_isa() {
+    static const e_sampler_isa isa = detect_isa();
+    return isa;
+}
+
+void sample_texture_batch(const c_decoded_texture& texture, int level, const float* u, const float* v,
+                          size_t count, uint32_t* out) {
+    if (count == 0) {
+        return;
+    }
+
+    if (!texture.ready.load(std::memory_order_acquire) || texture.pixels.empty() || texture.width <= 0 || texture.height <= 0) {
+        std::memset(out, 0, count * sizeof(uint32_t));
+        return;
+    }
+
+    c_sample_level sample_level;
+    sample_level.pixels = texture.level_pixels(level, sample_level.width, sample_level.height);
+    sample_level.palette = texture.palette.data();
+    sample_level.blocks_per_row = (sample_level.width + 3) >> 2;
+    sample_level.scale_x = static_cast<float>((sample_level.width - 1) * weight_one);
+    sample_level.scale_y = static_cast<float>((sample_level.height - 1) * weight_one);
+
+    // compressed texels are decoded per tap, no vector path for those
+    if (texture.format == e_texel_format::palette) {
+        sample_scalar<e_texel_format::palette, e_texel_layout::linear>(sample_level, u, v, count, out);
+    }
+    else if (texture.format == e_texel_format::bc1) {
+        sample_scalar<e_texel_format::bc1, e_texel_layout::linear>(sample_level, u, v, count, out);
+    }
+    else if (texture.layout == e_texel_layout::tiled) {
+        sample_layout<e_texel_layout::tiled>(sample_level, u, v, count, out);
+    }
+    else {
+        sample_layout<e_texel_layout::linear>(sample_level, u, v, count, out);
+    }
+}
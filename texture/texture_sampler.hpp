@@ -0,0 +1,20 @@
+#pragma once
+#include "texture_cache.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// instruction set sample_texture_batch runs on, picked once from cpuid
+enum class e_sampler_isa {
+    scalar,
+    sse41,
+    avx2
+};
+
+e_sampler_isa sampler_isa();
+
+// bilinear samples count (u, v) pairs from one mip level into packed rgba8, red in the low byte like IM_COL32.
+// weights are 14 bit fixed point and every channel stays within one lsb of c_decoded_texture::sample. pixels go
+// 8 at a time on avx2 and 4 at a time on sse4.1 (rgba8 levels only, palette and bc1 levels are decoded per tap),
+// a texture that isn't ready fills out with transparent black
+void sample_texture_batch(const c_decoded_texture& texture, int level, const float* u, const float* v,
+                          size_t count, uint32_t* out);